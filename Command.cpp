@@ -1,7 +1,7 @@
 /*
  * Command.c
  */
-#include "Arduino.h"
+#include "HAL.h"
 #include "Command.h"
 #include "Command_CFG.h"
 #include "Tool.h"
@@ -10,6 +10,8 @@
 #include "DimmerCmdList.h"
 #include "Dimmer.h"
 #include "Dimmer_Config.h"
+#include "Monitor.h"
+#include "Mains.h"
 
 #if defined(DEBUG_COMMAND)
 #define debug_tiny_printf(...) tiny_printf(__VA_ARGS__)
@@ -24,64 +26,235 @@
 #define COM_SPACE 32
 #define COM_NULL  0
 
-#define CMD_MAX_RX_BUFFER 16 // AA CC D1 D2 D3 ..
+// Binary frame: <SOF|Length><Address><Command><Length data bytes><CRC8>, CRC8 over all bytes before it
+#define COM_BIN_SOF       0xA0 // Upper nibble, never an ASCII character
+#define COM_BIN_SOF_MASK  0xF0
+#define COM_BIN_LEN_MASK  0x0F
 
-#define CheckSize(S, M) if (CMD.MultiAddress) { if (S != M) { return; } } else { if (S != M) { CMD_Write(COM_NAK); return; } else { CMD_Write(COM_ACK); }}
+#define CMD_MAX_DATA      16 // Address, Command and data in bytes, AA CC D1 D2 D3 .., batches AA CC D1 .. AA CC D1 ..
+
+// Commands executed from the queue do not answer, they were acknowledged when queued
+#define CMD_Answer(C) do { if (CMD.Queued == 0) { CMD_Write(C); } } while (0)
 
 typedef struct {
   uint8_t RX_Index = 0;
-  uint8_t RX_Buffer[CMD_MAX_RX_BUFFER];
-  uint8_t MultiAddress;
+  uint8_t RX_Buffer[CMD_MAX_DATA]; // Decoded bytes, also for ASCII hex commands
+  uint8_t RX_HighNibble; // ASCII hex, the high nibble of RX_Buffer[RX_Index] is received
+  uint8_t RX_Length;
+  uint8_t RX_Crc;
+  uint32_t RX_Cycle; // Dimmer cycle of the last byte of a binary frame
+  uint8_t Binary; // Format of the command being handled, replies use the same format
+  uint8_t MultiAddress; // Broadcast, group or batch, one ACK or NAK for all channels
+  uint8_t MultiFail;
+  uint8_t Batch;
+  uint8_t Queued; // Executing from the queue
 } COMMAND_t;
 
 static volatile COMMAND_t CMD;
 
+// Commands waiting for their Dimmer cycle, ordered by cycle
+#define CMD_QUEUE_DATA (CMD_MAX_DATA-5) // Queue frame minus its address and cycle
+
+typedef struct {
+  uint32_t Cycle;
+  uint8_t Size;
+  uint8_t Data[CMD_QUEUE_DATA]; // <Address><Command><Data>
+} CMD_QueueEntry_t;
+
+typedef struct {
+  uint8_t Head;
+  uint8_t Tail;
+  CMD_QueueEntry_t Entry[CMD_QUEUE_SIZE];
+} CMD_Queue_t;
+
+static CMD_Queue_t CMD_Queue;
+
+// Command handlers, Value is the checked first parameter (DIMMER_PARAM_MAGIC and DIMMER_PARAM_TIMER)
+// The return value is the reply of a read command
+typedef uint32_t (*CMD_Handler_t)(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData);
+
+#define CMD_HANDLER(Name, Address, Size, Param, Min, Max, Reply, Handler) \
+  static uint32_t Handler(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData);
+DIMMER_CMD_LIST(CMD_HANDLER)
+
+typedef struct {
+  uint8_t Size; // Data bytes
+  uint8_t Param; // DIMMER_PARAM_x
+  uint8_t Reply; // Reply bytes, 0 for a write command
+  uint16_t Min;
+  uint16_t Max;
+  CMD_Handler_t Handler;
+} CMD_Descriptor_t;
+
+#define CMD_DESCRIPTOR(Name, Address, Size, Param, Min, Max, Reply, Handler) \
+  { Size, Param, Reply, Min, Max, Handler },
+static const CMD_Descriptor_t CMD_Descriptor[] PROGMEM = {
+  DIMMER_CMD_LIST(CMD_DESCRIPTOR)
+};
+
+#define CMD_INDEX(Name, Address, Size, Param, Min, Max, Reply, Handler) CMD_INDEX_##Name,
+enum {
+  DIMMER_CMD_LIST(CMD_INDEX)
+  CMD_INDEX_NONE
+};
+
+// Index in CMD_Descriptor of a command, CMD_INDEX_NONE for an unknown command
+#define CMD_INDEX_OF(Name, Address, Size, Param, Min, Max, Reply, Handler) (Command == (Address)) ? (uint8_t)CMD_INDEX_##Name :
+constexpr uint8_t Command_IndexOf(uint16_t Command) {
+  return DIMMER_CMD_LIST(CMD_INDEX_OF) (uint8_t)CMD_INDEX_NONE;
+}
+
+// Descriptor index of every command value, so the command lookup takes the same time for every command
+#define CMD_INDEX_4(C)   Command_IndexOf(C), Command_IndexOf((C)+1), Command_IndexOf((C)+2), Command_IndexOf((C)+3)
+#define CMD_INDEX_16(C)  CMD_INDEX_4(C), CMD_INDEX_4((C)+4), CMD_INDEX_4((C)+8), CMD_INDEX_4((C)+12)
+#define CMD_INDEX_64(C)  CMD_INDEX_16(C), CMD_INDEX_16((C)+16), CMD_INDEX_16((C)+32), CMD_INDEX_16((C)+48)
+static const uint8_t CMD_Index[256] PROGMEM = {
+  CMD_INDEX_64(0), CMD_INDEX_64(64), CMD_INDEX_64(128), CMD_INDEX_64(192)
+};
+
+static_assert(CMD_INDEX_NONE < 0xFF, "Too many commands");
+static_assert(Command_IndexOf(DIMMER_CMD_GET_VERSION_ADDR) == CMD_INDEX_GET_VERSION, "Command list");
+static_assert(DIMMER_CMD_SET_SEQUENCE_SIZE == (1 + DIMMER_SEQUENCE_SIZE*3)*2, "SetSequence carries DIMMER_SEQUENCE_SIZE keyframes");
+static_assert(2 + DIMMER_CMD_SET_SEQUENCE_SIZE/2 <= CMD_MAX_DATA, "SetSequence does not fit in the receive buffer");
+
+static void Command_Receive(uint8_t C);
+static void Command_Execute(uint8_t *pData, uint8_t Size);
+static void Command_Dimmer(Dimmer_Select_t DimmerSelect, uint8_t *pData, uint8_t Size);
+static void Command_Reply(uint32_t Value, uint8_t Bytes);
+#if defined(DEBUG_COMMAND_BENCHMARK)
+static void Command_Benchmark(void);
+#endif
+
 void Command_Initialize(void) {
   debug_tiny_printf("Command: Begin init\n");
   CMD.RX_Index = 0;
+  CMD.RX_HighNibble = 0;
+  CMD.Binary = 0;
   CMD.MultiAddress = 0;
+  CMD.MultiFail = 0;
+  CMD.Batch = 0;
+  CMD.Queued = 0;
+  CMD_Queue.Head = 0;
+  CMD_Queue.Tail = 0;
+#if defined(DEBUG_COMMAND_BENCHMARK)
+  Command_Benchmark();
+#endif
   debug_tiny_printf("Command: End init\n");
 }
 
 void Command_Scheduler(void) {
-  static uint8_t State = 0;
   uint8_t C;
+  if (CMD_WriteFree() < CMD_ANSWER_MAX) {
+    return; // Backpressure, the bytes wait in the RX buffer until the answers are sent
+  }
   if (CMD_Read(&C) == 0) {
     return;
   }
+  Command_Receive(C);
+}
+
+// Decodes every character when it is received, at ETX (or the CRC) the command is complete and executed
+static void Command_Receive(uint8_t C) {
+  static uint8_t State = 0;
+  uint8_t Nibble;
+
+  if ((State == 2) && ((Dimmer_GetCycle() - CMD.RX_Cycle) > CMD_BIN_TIMEOUT)) {
+    // Idle gap in a binary frame, a byte got lost, resync on this byte
+    debug_tiny_printf("Fail: Binary frame timeout\n");
+    State = 0;
+  }
+
+  if (State == 2) {
+    // Binary frame, every byte value is allowed
+    CMD.RX_Cycle = Dimmer_GetCycle();
+    if (CMD.RX_Index < CMD.RX_Length) {
+      CMD.RX_Buffer[CMD.RX_Index++] = C;
+      CMD.RX_Crc = CRC8_Update(CMD.RX_Crc, C);
+      return;
+    }
+    State = 0;
+    CMD.Binary = 1;
+    if (C != CMD.RX_Crc) {
+      debug_tiny_printf("Fail: CRC\n");
+      CMD_Write(COM_NAK);
+      return;
+    }
+    debug_tiny_printf("Executing binary command\n");
+    Command_Execute((uint8_t *)CMD.RX_Buffer, CMD.RX_Length);
+    return;
+  }
 
   if ((C == COM_NULL)  || (C == COM_SPACE)) {
     return;
   }
 
+  if (C == COM_STX) {
+    // Also restarts when the ETX of the previous command got lost
+    CMD.RX_Index = 0;
+    CMD.RX_HighNibble = 0;
+    State = 1;
+    return;
+  }
+
   switch(State) {
   case 0:
-    if (C == COM_STX) {
+    if ((C & COM_BIN_SOF_MASK) == COM_BIN_SOF) {
       CMD.RX_Index = 0;
-      State++;
+      CMD.RX_Length = (C & COM_BIN_LEN_MASK) + 2; // Address and Command
+      CMD.RX_Crc = CRC8_Update(0, C);
+      CMD.RX_Cycle = Dimmer_GetCycle();
+      if (CMD.RX_Length <= CMD_MAX_DATA) {
+        State = 2;
+      } else {
+        debug_tiny_printf("Fail: Binary frame too long\n");
+      }
     }
     break;
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
   case 1:
     if (C == COM_ETX) {
-      State++;
-    } else {
-      if (CMD.RX_Index < CMD_MAX_RX_BUFFER) {
-        CMD.RX_Buffer[CMD.RX_Index++] = C;
+      State = 0;
+#if defined(DEBUG_COMMAND)
+      tiny_printf("Command: ");
+      for (uint8_t i = 0; i < CMD.RX_Index; i++) {
+        tiny_printf("%02x", CMD.RX_Buffer[i]);
+      }
+      tiny_printf(" with size %d\n", CMD.RX_Index);
+#endif
+      if (CMD.RX_Index < 2) {
+        debug_tiny_printf("Message too small\n");
+        CMD_Write(COM_NAK);
         return;
-      } else {
+      }
+      if (CMD.RX_HighNibble) {
+        debug_tiny_printf("Message not multiple of 2 bytess\n");
+        CMD_Write(COM_NAK);
+        return;
+      }
+      debug_tiny_printf("Executing CommandHandler\n");
+      CMD.Binary = 0;
+      Command_Execute((uint8_t *)CMD.RX_Buffer, CMD.RX_Index);
+      return;
+    }
+    Nibble = ConvertHexNibble(C);
+    if (Nibble > 0x0F) {
+      debug_tiny_printf("Message not hex format\n");
+      CMD_Write(COM_NAK);
+      State = 0;
+      return;
+    }
+    if (CMD.RX_HighNibble == 0) {
+      if (CMD.RX_Index >= CMD_MAX_DATA) {
         State = 0;
         debug_tiny_printf("Fail: Receive buffer overflow\n");
         return;
       }
+      CMD.RX_Buffer[CMD.RX_Index] = Nibble << 4;
+      CMD.RX_HighNibble = 1;
+    } else {
+      CMD.RX_Buffer[CMD.RX_Index++] |= Nibble;
+      CMD.RX_HighNibble = 0;
     }
-  case 2:
-    debug_tiny_printf("Executing CommandHandler\n");
-    Command_Handler((uint8_t *)CMD.RX_Buffer, CMD.RX_Index);
-    State = 0;
     break;
-#pragma GCC diagnostic pop
   default:
     State = 0;
     break;
@@ -90,227 +263,600 @@ void Command_Scheduler(void) {
 
 // TODO every return is always with an address?
 
+// ASCII hex command (without STX and ETX)
 void Command_Handler(uint8_t *pBuffer, uint8_t Size) {
-  uint8_t Address;
-  uint8_t Command;
-  uint8_t Magic;
-  uint16_t DurationMS;
-  uint8_t Brightness;
-  Dimmer_Select_t DimmerSelect;
-  uint8_t Value_u8;
-  uint16_t Value_u16;
-#if defined(DEBUG_COMMAND)
-  tiny_printf("Command: ");
+  Command_Receive(COM_STX);
   for (uint8_t i = 0; i < Size; i++) {
-    CMD_Write(pBuffer[i]);
+    Command_Receive(pBuffer[i]);
   }
-  tiny_printf(" with size %d\n", Size);
-#endif
+  Command_Receive(COM_ETX);
+}
 
-  if (Size < 4) {
-    debug_tiny_printf("Message too small\n");
-    CMD_Write(COM_NAK);
-    return;
+// Data size in bytes of a write command, 0xFF for an unknown command
+static uint8_t Command_DataSize(uint8_t Command) {
+  uint8_t Index;
+
+  Index = pgm_read_byte_near(&CMD_Index[Command]);
+  if ((Index == CMD_INDEX_NONE) || (Command & 0x80)) {
+    return 0xFF;
+  }
+  return pgm_read_byte_near(&CMD_Descriptor[Index].Size);
+}
+
+// Channel mask of a (multi) address, pData points to the Address and is moved to the Command
+// Returns 0 for an incorrect address
+static uint8_t Command_Address(uint8_t **ppData, uint8_t *pSize) {
+  uint8_t Address;
+  uint8_t Mask;
+
+  Address = *(*ppData)++;
+  (*pSize)--;
+  if (Address < DimmerMAX) {
+    CMD.MultiAddress = 0;
+    return (1 << Address);
+  }
+  switch (Address) {
+  case DIMMER_ADDR_BROADCAST:
+    CMD.MultiAddress = 1;
+    return (uint8_t)((1 << DimmerMAX) - 1);
+  case DIMMER_ADDR_GROUP:
+    if (*pSize == 0) {
+      return 0;
+    }
+    Mask = *(*ppData)++;
+    (*pSize)--;
+    CMD.MultiAddress = 1;
+    return Mask & (uint8_t)((1 << DimmerMAX) - 1);
+  default:
+    return 0;
+  }
+}
+
+// Runs the command for every channel of the mask, multi addresses get one ACK or NAK for all
+static void Command_Multi(uint8_t Mask, uint8_t *pData, uint8_t Size) {
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    if (Mask & (1 << i)) {
+      Command_Dimmer((Dimmer_Select_t)i, pData, Size);
+    }
+  }
+  if (CMD.MultiAddress) {
+    if (((pData[0] & 0x80) == 0) && (CMD.Batch == 0)) {
+      CMD_Answer(CMD.MultiFail ? COM_NAK : COM_ACK);
+    }
+  }
+}
+
+// <Address|Broadcast|Group Mask><Command><Data> tuples, all are checked before any is executed
+// Executed in one go, so all changes are taken by the same zero crossing, with one ACK or NAK
+static void Command_Batch(uint8_t *pData, uint8_t Size) {
+  uint8_t Pass;
+  uint8_t *pTuple;
+  uint8_t TupleSize;
+  uint8_t Remaining;
+  uint8_t Mask;
+  uint8_t DataSize;
+
+  CMD.Batch = 1;
+  for (Pass = 0; Pass < 2; Pass++) {
+    pTuple = pData;
+    Remaining = Size;
+    while (Remaining != 0) {
+      Mask = Command_Address(&pTuple, &Remaining);
+      if ((Mask == 0) || (Remaining == 0)) {
+        break;
+      }
+      DataSize = Command_DataSize(pTuple[0]);
+      if ((DataSize == 0xFF) || (DataSize >= Remaining)) {
+        break;
+      }
+      TupleSize = DataSize + 1;
+      if (Pass == 1) {
+        CMD.MultiAddress = 1;
+        Command_Multi(Mask, pTuple, TupleSize);
+      }
+      pTuple += TupleSize;
+      Remaining -= TupleSize;
+    }
+    if (Remaining != 0) {
+      debug_tiny_printf("Incorrect batch\n");
+      CMD_Answer(COM_NAK);
+      CMD.Batch = 0;
+      return;
+    }
   }
-  
-  if (Size%2 != 0) {
-    debug_tiny_printf("Message not multiple of 2 bytess\n");
-    CMD_Write(COM_NAK);
+  CMD.Batch = 0;
+  CMD_Answer(CMD.MultiFail ? COM_NAK : COM_ACK);
+}
+
+// <Cycle, 4 bytes><Address><Command><Data>, queued to be executed by Command_QueueScheduler on Cycle
+static void Command_Queue(uint8_t *pData, uint8_t Size) {
+  CMD_QueueEntry_t *pEntry;
+  uint32_t Cycle;
+  uint8_t Next;
+
+  Next = (CMD_Queue.Head + 1) % CMD_QUEUE_SIZE;
+  if ((Size < 6) || ((Size - 4) > CMD_QUEUE_DATA) || (pData[4] == DIMMER_ADDR_QUEUE) || (Next == CMD_Queue.Tail)) {
+    debug_tiny_printf("Incorrect queue or queue full\n");
+    CMD_Answer(COM_NAK);
     return;
   }
-  for (uint8_t i = 0; i< Size; i++) {
-    if (CheckHex(pBuffer[i])) {
-    } else {
-      debug_tiny_printf("Message not hex format\n");
-      CMD_Write(COM_NAK);
+  Cycle = ((uint32_t)pData[0]<<24) + ((uint32_t)pData[1]<<16) + ((uint16_t)pData[2]<<8) + pData[3];
+  if (CMD_Queue.Head != CMD_Queue.Tail) {
+    pEntry = &CMD_Queue.Entry[(CMD_Queue.Head + CMD_QUEUE_SIZE - 1) % CMD_QUEUE_SIZE];
+    if ((int32_t)(Cycle - pEntry->Cycle) < 0) {
+      debug_tiny_printf("Queue cycle before previous\n");
+      CMD_Answer(COM_NAK);
+      return;
     }
   }
+  pEntry = &CMD_Queue.Entry[CMD_Queue.Head];
+  pEntry->Cycle = Cycle;
+  pEntry->Size = Size - 4;
+  for (uint8_t i = 0; i < pEntry->Size; i++) {
+    pEntry->Data[i] = pData[4+i];
+  }
+  CMD_Queue.Head = Next;
+  CMD_Answer(COM_ACK);
+}
 
-  Size -= 4; // Remove Address and Command size
+// Called by Dimmer_Scheduler for every new cycle, before the dimmers are calculated
+// Executes all queued commands of Cycle (or earlier, when the main loop was late)
+void Command_QueueScheduler(uint32_t Cycle) {
+  CMD_QueueEntry_t *pEntry;
 
-  Address = ConvertHexToU8(pBuffer);
-  pBuffer+=2;
+  while (CMD_Queue.Tail != CMD_Queue.Head) {
+    pEntry = &CMD_Queue.Entry[CMD_Queue.Tail];
+    if ((int32_t)(Cycle - pEntry->Cycle) < 0) {
+      return;
+    }
+    CMD.Queued = 1;
+    Command_Execute(pEntry->Data, pEntry->Size);
+    CMD.Queued = 0;
+    CMD_Queue.Tail = (CMD_Queue.Tail + 1) % CMD_QUEUE_SIZE;
+  }
+}
 
-  switch(Address) {
-  case 0x00:
-    DimmerSelect = Dimmer0;
-    break;
-  case 0x01:
-    DimmerSelect = Dimmer1;
-    break;
-  default:
-      debug_tiny_printf("Incorrect Address 0x%02x, ignoring\n", Address);
-      // don not reply, ignore
+// pData = <Address><Command><Data>, Size in bytes
+static void Command_Execute(uint8_t *pData, uint8_t Size) {
+  uint8_t Mask;
+
+  CMD.MultiFail = 0;
+  if (pData[0] == DIMMER_ADDR_QUEUE) {
+    Command_Queue(pData+1, Size-1);
+    return;
+  }
+  if (pData[0] == DIMMER_ADDR_BATCH) {
+    Command_Batch(pData+1, Size-1);
+    return;
+  }
+  Mask = Command_Address(&pData, &Size);
+  if ((Mask == 0) || (Size == 0)) {
+    debug_tiny_printf("Incorrect Address, ignoring\n");
+    // don not reply, ignore
+    return;
+  }
+  Command_Multi(Mask, pData, Size);
+}
+
+// pData = <Command><Data>, Size in bytes
+static void Command_Dimmer(Dimmer_Select_t DimmerSelect, uint8_t *pData, uint8_t Size) {
+  CMD_Descriptor_t Descriptor;
+  uint8_t Command;
+  uint8_t Index;
+  uint16_t Value = 0;
+  uint32_t Reply;
+
+  Size -= 1; // Remove Command size
+
+  Command = *pData++;
+  debug_tiny_printf("Command %i\n", Command);
+  debug_tiny_printf("Size %i\n", Size);
+  Index = pgm_read_byte_near(&CMD_Index[Command]);
+  if (CMD.MultiAddress) {
+    if (Command & 0x80) {
+      return; // Multi addresses do not return an answer, NAK or ACK
+    }
+    if ((Index == CMD_INDEX_NONE) || (Size != pgm_read_byte_near(&CMD_Descriptor[Index].Size))) {
+      debug_tiny_printf("Incorrect CMD 0x%02x (Addr 0x%02x)\n", Command, DimmerSelect);
+      CMD.MultiFail = 1;
       return;
+    }
+  } else {
+    if ((Index == CMD_INDEX_NONE) || (Size != pgm_read_byte_near(&CMD_Descriptor[Index].Size))) {
+      debug_tiny_printf("Incorrect CMD 0x%02x (Addr 0x%02x)\n", Command, DimmerSelect);
+      CMD_Answer(COM_NAK);
+      return;
+    }
+    CMD_Answer(COM_ACK);
   }
 
-  /*switch(Address) {
-  case 0x00:
-    CMD.MultiAddress = 0;
+  memcpy_P(&Descriptor, &CMD_Descriptor[Index], sizeof(Descriptor));
+  switch (Descriptor.Param) {
+  case DIMMER_PARAM_MAGIC:
+    Value = pData[0];
+    if ((Value < Descriptor.Min) || (Value > Descriptor.Max)) {
+      return; // Ignore command
+    }
     break;
-  case 0x10:
-    CMD.MultiAddress = 1;
+  case DIMMER_PARAM_TIMER:
+    Value = ((uint16_t)pData[0]<<8) + pData[1];
+    if (Settings.MainzHZ == 60) {
+      CLIPtoMin(Value, SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
+    } else {
+      CLIPtoMin(Value, SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
+    }
     break;
   default:
-      debug_tiny_printf("Incorrect Address 0x%02x, ignoring\n", Address);
-      // don not reply, ignore
-      return;
-  }*/
+    break;
+  }
+  Reply = Descriptor.Handler(DimmerSelect, Value, pData);
+  if (Descriptor.Reply != 0) {
+    Command_Reply(Reply, Descriptor.Reply);
+  }
+}
 
-  Command = ConvertHexToU8(pBuffer);
-  pBuffer+=2;
-  debug_tiny_printf("Command %i\n", Command);
-  debug_tiny_printf("Size %i\n", Size);
-  // Handle commands
-  if ((Command & 0x80) == 0) {
-// Write commands
-    switch (Command) {
-    case DIMMER_CMD_OFF_ADDR:
-      CheckSize(Size, DIMMER_CMD_OFF_SIZE);
-      Dimmer_SetBrightness(DimmerSelect, 0);
-      break;
-    case DIMMER_CMD_ON_MAX_ADDR:
-      CheckSize(Size, DIMMER_CMD_ON_MAX_SIZE);
-      Dimmer_SetBrightness(DimmerSelect, 254);
-      break;
-    case DIMMER_CMD_STOP_ADDR:
-      CheckSize(Size, DIMMER_CMD_STOP_SIZE);
-      Dimmer_SetBrightness(DimmerSelect, 255);
-      break;
-    case DIMMER_CMD_SET_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_SIZE);
-      Brightness = ConvertHexToU8(pBuffer);
-      debug_tiny_printf("Set %i\n", Brightness);
-      Dimmer_SetBrightness(DimmerSelect, Brightness);
-      break;
-    case DIMMER_CMD_SET_FADE_TIME_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_FADE_TIME_SIZE);
-      Brightness = ConvertHexToU8(pBuffer);
-      DurationMS = ConvertHexToU16(pBuffer+2);
-      Dimmer_SetFade(DimmerSelect, DurationMS, Brightness);
-      break;
-    case DIMMER_CMD_SET_FADE_STEPS_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_FADE_STEPS_SIZE);
-      Value_u16 = ConvertHexToU16(pBuffer);
-      if (Settings.MainzHZ == 60) {
-        CLIPtoMin(Value_u16, SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
-      } else {
-        CLIPtoMin(Value_u16, SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
-      }
-      // TODO create Fade steps algoritmn
-      Dimmer_SetDirectValue(DimmerSelect, Value_u16);
-      break;
-    case DIMMER_CMD_SAVE_ADDR:				
-      CheckSize(Size, DIMMER_CMD_SAVE_SIZE);
-      Magic = ConvertHexToU8(pBuffer);
-      if (Magic == DIMMER_CMD_SAVE_MAGIC_NUMBER) {
-        SET_Save();
-      } // else ignore command
-      break;
-    case DIMMER_CMD_LOAD_ADDR:				
-      CheckSize(Size, DIMMER_CMD_LOAD_SIZE);
-      Magic = ConvertHexToU8(pBuffer);
-      if (Magic == DIMMER_CMD_LOAD_MAGIC_NUMBER) {
-        SET_Load();
-        Dimmer_UpdateDaliTable(Settings.RangeMin, Settings.RangeMax);
-      } // else ignore command
-      break;
-    case DIMMER_CMD_LOAD_SCRATCH_ADDR:		
-      CheckSize(Size, DIMMER_CMD_LOAD_SCRATCH_SIZE);
-      Magic = ConvertHexToU8(pBuffer);
-      if (Magic == DIMMER_CMD_LOAD_SCRATCH_MAGIC_NUMBER) {
-        SET_LoadScratch();
-        Dimmer_UpdateDaliTable(Settings.RangeMin, Settings.RangeMax);
-      } // else ignore command
-      break;
-    case DIMMER_CMD_SET_MAINZ_HZ_VAL_ADDR:	
-      CheckSize(Size, DIMMER_CMD_SET_MAINZ_HZ_VAL_SIZE);
-      Value_u8 = ConvertHexToU16(pBuffer);
-      if (Value_u8 == 50) {
-        Settings.MainzHZ = 50;
-      }
-      if (Value_u8 == 60) {
-        Settings.MainzHZ = 60;
-      }
-      // else ignore command
-      break;
-    case DIMMER_CMD_SET_TIMER_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_TIMER_VAL_SIZE);
-      Value_u16 = ConvertHexToU16(pBuffer);
-      if (Settings.MainzHZ == 60) {
-        CLIPtoMin(Value_u16, SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
-      } else {
-        CLIPtoMin(Value_u16, SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
-      }
-      Dimmer_SetDirectValue(DimmerSelect, Value_u16);
-      break;		
-    case DIMMER_CMD_SET_CAL_LOW_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_CAL_LOW_VAL_SIZE);
-      Settings.RangeMin = ConvertHexToU16(pBuffer);
-      Dimmer_UpdateDaliTable(Settings.RangeMin, Settings.RangeMax);
-      break;
-    case DIMMER_CMD_SET_CAL_HIGH_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_SET_CAL_HIGH_VAL_SIZE);
-      Settings.RangeMax = ConvertHexToU16(pBuffer);
-      Dimmer_UpdateDaliTable(Settings.RangeMin, Settings.RangeMax);
-      break;
-    default:
-      debug_tiny_printf("Incorrect CMD WR 0x%02x (Addr 0x%02x)\n", Command, Address);
-      if (CMD.MultiAddress == 0) {
-        CMD_Write(COM_NAK);
-      }
-      break;
+static uint32_t Command_Off(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  Dimmer_SetBrightness(DimmerSelect, 0);
+  return 0;
+}
+
+static uint32_t Command_OnMax(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  Dimmer_SetBrightness(DimmerSelect, 254);
+  return 0;
+}
+
+static uint32_t Command_Stop(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  Dimmer_SetBrightness(DimmerSelect, 255);
+  return 0;
+}
+
+static uint32_t Command_ClearQueue(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  CMD_Queue.Tail = CMD_Queue.Head;
+  return 0;
+}
+
+static uint32_t Command_ResetMonitor(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  Monitor_Reset();
+  USARTP_ResetDrops();
+  return 0;
+}
+
+static uint32_t Command_Set(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  debug_tiny_printf("Set %i\n", pData[0]);
+  Dimmer_SetBrightness(DimmerSelect, pData[0]);
+  return 0;
+}
+
+static uint32_t Command_GetSet(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  return Dimmer_GetBrightness(DimmerSelect);
+}
+
+static uint32_t Command_SetFadeTime(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  Dimmer_SetFade(DimmerSelect, ((uint16_t)pData[1]<<8) + pData[2], pData[0]);
+  return 0;
+}
+
+static uint32_t Command_SetFadeProfile(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  Dimmer_SetFadeProfile(DimmerSelect, ((uint16_t)pData[1]<<8) + pData[2], pData[0], (Dimmer_Profile_t)pData[3]);
+  return 0;
+}
+
+static uint32_t Command_SetSequence(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  Dimmer_Keyframe_t Keyframe[DIMMER_SEQUENCE_SIZE];
+  (void)Value;
+  for (uint8_t i = 0; i < DIMMER_SEQUENCE_SIZE; i++) {
+    Keyframe[i].Brightness = pData[1+i*3];
+    Keyframe[i].DurationMS = ((uint16_t)pData[2+i*3]<<8) + pData[3+i*3];
+  }
+  Dimmer_SetSequence(DimmerSelect, Keyframe, pData[0] & 0x0F, pData[0] >> 7, (Dimmer_Profile_t)((pData[0] >> 4) & 0x07));
+  return 0;
+}
+
+static uint32_t Command_GetSequence(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  return Dimmer_GetSequence(DimmerSelect);
+}
+
+static uint32_t Command_SetFadeSteps(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  Dimmer_SetFadeRate(DimmerSelect, pData[0], pData[1], pData[2]);
+  return 0;
+}
+
+static uint32_t Command_Save(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  SET_Save();
+  return 0;
+}
+
+static uint32_t Command_GetSaveStatus(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return SET_SaveBusy();
+}
+
+static uint32_t Command_Load(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  SET_Load();
+  return 0;
+}
+
+static uint32_t Command_LoadScratch(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  SET_LoadScratch();
+  return 0;
+}
+
+static uint32_t Command_SetMainzHz(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)pData;
+  if ((Value == 50) || (Value == 60)) {
+    Settings.MainzHZ = Value;
+  } // else ignore command
+  return 0;
+}
+
+static uint32_t Command_GetMainzHz(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return Settings.MainzHZ;
+}
+
+static uint32_t Command_SetTimerValue(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)pData;
+  Dimmer_SetDirectValue(DimmerSelect, Value);
+  return 0;
+}
+
+static uint32_t Command_GetTimerValue(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  return Dimmer_GetDirectValue(DimmerSelect);
+}
+
+// The calibration is used from the next OCR value of the dimmer
+static uint32_t Command_SetCalLow(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  Settings.RangeMin[DimmerSelect] = ((uint16_t)pData[0]<<8) + pData[1];
+  return 0;
+}
+
+static uint32_t Command_GetCalLow(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  return Settings.RangeMin[DimmerSelect];
+}
+
+static uint32_t Command_SetCalHigh(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value;
+  Settings.RangeMax[DimmerSelect] = ((uint16_t)pData[0]<<8) + pData[1];
+  return 0;
+}
+
+static uint32_t Command_GetCalHigh(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)Value; (void)pData;
+  return Settings.RangeMax[DimmerSelect];
+}
+
+static uint32_t Command_GetCalRange(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  if (Settings.MainzHZ == 50) {
+    return SET_DIM_RANGE_MAX_50HZ;
+  }
+  return SET_DIM_RANGE_MAX_60HZ;
+}
+
+static uint32_t Command_GetCycle(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return Dimmer_GetCycle();
+}
+
+static uint32_t Command_GetMonitor(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)pData;
+  if (Value == MonitorMAX) {
+    return Monitor_GetMissedCycles();
+  }
+  if (Value == MonitorMAX+1) {
+    return ((uint32_t)USARTP_GetDrops() << 16) + USARTP_GetDebugDrops();
+  }
+  if (Value == MonitorMAX+2) {
+    return Monitor_GetRejectedCaptures();
+  }
+  HAL_Bench_t Max = Monitor_GetMax((Monitor_Select_t)Value);
+  if (Max > 0xFFFF) {
+    Max = 0xFFFF; // Host nanoseconds
+  }
+  return ((uint32_t)Max << 16) + Monitor_GetAverage((Monitor_Select_t)Value);
+}
+
+static uint32_t Command_GetMains(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return ((uint32_t)Mains_GetHz() << 16) + Mains_GetHalfPeriod();
+}
+
+static uint32_t Command_GetCmdVersion(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return DIMMER_CMD_VERSION;
+}
+
+static uint32_t Command_GetVersion(Dimmer_Select_t DimmerSelect, uint16_t Value, const uint8_t *pData) {
+  (void)DimmerSelect; (void)Value; (void)pData;
+  return DIMMER_VERSION;
+}
+
+// Reply of 1, 2 or 4 bytes, #xx, #xxxx or #xxxxxxxx in ASCII, <SOF|Bytes><Data><CRC8> in binary
+// Written directly, the time only depends on Bytes
+static void Command_Reply(uint32_t Value, uint8_t Bytes) {
+  uint8_t Crc = 0;
+  uint8_t Byte;
+  if (CMD.Queued) {
+    return;
+  }
+  if (CMD.Binary == 0) {
+    CMD_Write(COM_STX);
+  } else {
+    Byte = COM_BIN_SOF | Bytes;
+    CMD_Write(Byte);
+    Crc = CRC8_Update(0, Byte);
+  }
+  while (Bytes != 0) {
+    Bytes--;
+    Byte = (uint8_t)(Value >> (Bytes*8));
+    if (CMD.Binary == 0) {
+      CMD_Write(ConvertNibbleToHex(Byte >> 4));
+      CMD_Write(ConvertNibbleToHex(Byte & 0x0F));
+    } else {
+      CMD_Write(Byte);
+      Crc = CRC8_Update(Crc, Byte);
     }
+  }
+  if (CMD.Binary == 0) {
+    CMD_Write(COM_ETX);
   } else {
-    if (CMD.MultiAddress) {
-      return; // Multi addresses do not return an answer, NAK or ACK
+    CMD_Write(Crc);
+  }
+}
+
+#if defined(DEBUG_COMMAND_BENCHMARK)
+// Receive and decode time per character, streaming decoder against buffering all characters and checking and converting them at ETX (as before)
+// The address 0x0f is ignored by Command_Execute, so only the receive path is measured
+// Time is in HAL_BenchTicks, Timer1 ticks (8 CPU cycles) or nanoseconds on the host, DEBUG_COMMAND should be disabled
+static void Command_Benchmark(void) {
+  const uint8_t Frame[] = "0f11fe03e8";
+  uint8_t Buffer[sizeof(Frame)];
+  uint8_t Size = sizeof(Frame) - 1;
+  HAL_Bench_t StreamChar = 0;
+  HAL_Bench_t StreamMax = 0;
+  HAL_Bench_t StreamETX;
+  HAL_Bench_t BufferChar = 0;
+  HAL_Bench_t BufferMax = 0;
+  HAL_Bench_t BufferETX;
+  uint8_t Valid;
+  HAL_Bench_t T0, T1;
+
+  tiny_printf("Command: Begin benchmark\n");
+  USARTP_FlushTX_Buffer();
+
+  Command_Receive(COM_STX);
+  for (uint8_t i = 0; i < Size; i++) {
+    T0 = HAL_BenchTicks();
+    Command_Receive(Frame[i]);
+    T1 = HAL_BenchTicks();
+    StreamChar += (HAL_Bench_t)(T1-T0);
+    if ((HAL_Bench_t)(T1-T0) > StreamMax) {
+      StreamMax = T1-T0;
     }
-    debug_tiny_printf("Read\n");
-    switch (Command) {
-    case DIMMER_CMD_GET_SET_ADDR:								
-      CheckSize(Size, DIMMER_CMD_GET_SET_SIZE);
-      Value_u8 =  Dimmer_GetBrightness(DimmerSelect);
-      tiny_printf("#%02x\n", Value_u8);
-      break;
-    case DIMMER_CMD_GET_MAINZ_HZ_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_GET_MAINZ_HZ_VAL_SIZE);
-      tiny_printf("#%02x\n", Settings.MainzHZ);
-      break;		
-    case DIMMER_CMD_GET_TIMER_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_GET_TIMER_VAL_SIZE);
-      Value_u16 = Dimmer_GetDirectValue(DimmerSelect);
-      tiny_printf("#%04x\n", Value_u16);
-      break;
-    case DIMMER_CMD_GET_CAL_LOW_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_GET_CAL_LOW_VAL_SIZE);
-      // TODO create range for every dimmer separately
-      tiny_printf("#%04x\n", Settings.RangeMin);
-      break;
-    case DIMMER_CMD_GET_CAL_HIGH_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_GET_CAL_HIGH_VAL_SIZE);
-      // TODO create range for every dimmer separately
-      tiny_printf("#%04x\n", Settings.RangeMax);
-      break;
-    case DIMMER_CMD_GET_CAL_RANGE_VAL_ADDR:
-      CheckSize(Size, DIMMER_CMD_GET_CAL_RANGE_VAL_SIZE);
-      if (Settings.MainzHZ == 50) {
-        tiny_printf("#%04x\n", SET_DIM_RANGE_MAX_50HZ);
-      } else {
-        tiny_printf("#%04x\n", SET_DIM_RANGE_MAX_60HZ);
+  }
+  T0 = HAL_BenchTicks();
+  Command_Receive(COM_ETX);
+  T1 = HAL_BenchTicks();
+  StreamETX = T1-T0;
+
+  for (uint8_t i = 0; i < Size; i++) {
+    T0 = HAL_BenchTicks();
+    Buffer[i] = Frame[i];
+    T1 = HAL_BenchTicks();
+    BufferChar += (HAL_Bench_t)(T1-T0);
+    if ((HAL_Bench_t)(T1-T0) > BufferMax) {
+      BufferMax = T1-T0;
+    }
+  }
+  T0 = HAL_BenchTicks();
+  Valid = 1;
+  for (uint8_t i = 0; i < Size; i++) {
+    if (!CheckHex(Buffer[i])) {
+      Valid = 0;
+    }
+  }
+  for (uint8_t i = 0; Valid && (i < Size/2); i++) {
+    CMD.RX_Buffer[i] = ConvertHexToU8(Buffer+(i*2));
+  }
+  T1 = HAL_BenchTicks();
+  BufferETX = T1-T0;
+
+  tiny_printf("Characters %u\n", Size);
+  tiny_printf("Stream ticks per char %u max %u ETX %u\n", StreamChar/Size, StreamMax, StreamETX);
+  tiny_printf("Buffer ticks per char %u max %u ETX %u\n", BufferChar/Size, BufferMax, BufferETX);
+
+  // Command lookup and descriptor read for every command value, the time is the same for known and unknown commands
+  CMD_Descriptor_t Descriptor;
+  uint32_t Lookup = 0;
+  HAL_Bench_t LookupMax = 0;
+  HAL_Bench_t Handler;
+  HAL_Bench_t HandlerMax = 0;
+  uint8_t Index;
+  uint8_t HandlerMaxCommand = 0;
+  for (uint16_t Command = 0; Command < 256; Command++) {
+    T0 = HAL_BenchTicks();
+    Index = pgm_read_byte_near(&CMD_Index[Command]);
+    if (Index != CMD_INDEX_NONE) {
+      memcpy_P(&Descriptor, &CMD_Descriptor[Index], sizeof(Descriptor));
+    }
+    T1 = HAL_BenchTicks();
+    Lookup += (HAL_Bench_t)(T1-T0);
+    if ((HAL_Bench_t)(T1-T0) > LookupMax) {
+      LookupMax = T1-T0;
+    }
+    // Only read handlers, write handlers change the dimmer and settings
+    if ((Index != CMD_INDEX_NONE) && (Descriptor.Reply != 0)) {
+      T0 = HAL_BenchTicks();
+      Descriptor.Handler(Dimmer0, 0, (const uint8_t *)CMD.RX_Buffer);
+      T1 = HAL_BenchTicks();
+      Handler = T1-T0;
+      if (Handler > HandlerMax) {
+        HandlerMax = Handler;
+        HandlerMaxCommand = Command;
       }
-      break;
-    case DIMMER_CMD_GET_CMD_VERSION_ADDR:
-    	CheckSize(Size, DIMMER_CMD_GET_CMD_VERSION_SIZE);
-      tiny_printf("#%02x\n", DIMMER_CMD_VERSION);	
-      break;
-    case DIMMER_CMD_GET_VERSION_ADDR:
-    	CheckSize(Size, DIMMER_CMD_GET_VERSION_SIZE);
-      tiny_printf("#%02x\n", DIMMER_VERSION);	
-      break;
-    default:
-      debug_tiny_printf("Incorrect CMD RD 0x%02x (Addr 0x%02x)\n", Command, Address);
-      CMD_Write(COM_NAK);
-      break;
     }
   }
+  tiny_printf("Lookup ticks per command %u max %u\n", Lookup/256, LookupMax);
+  tiny_printf("Read handler ticks max %u (0x%02x)\n", HandlerMax, HandlerMaxCommand);
+
+  // Reply and debug output, runtime format parsing (C tiny_printf) against the PROGMEM format
+  // with typed arguments (C++ tiny_printf) and the fixed reply of Command_Reply
+  const char *Method[] = { "Runtime #%04x", "Typed #%04x", "Command_Reply", "Runtime %u %u", "Typed %u %u" };
+  uint32_t Print[5] = { 0 };
+  HAL_Bench_t PrintMax[5] = { 0 };
+  uint16_t Value;
+  CMD.Binary = 0;
+  for (uint8_t Round = 0; Round < 16; Round++) {
+    Value = (uint16_t)(Round * 4099);
+    for (uint8_t m = 0; m < 5; m++) {
+      USARTP_FlushTX_Buffer();
+      T0 = HAL_BenchTicks();
+      switch (m) {
+      case 0:
+        (tiny_printf)("#%04x\n", Value);
+        break;
+      case 1:
+        tiny_printf("#%04x\n", Value);
+        break;
+      case 2:
+        Command_Reply(Value, 2);
+        break;
+      case 3:
+        (tiny_printf)("Channels %u events %u\n", Round, Value);
+        break;
+      default:
+        tiny_printf("Channels %u events %u\n", Round, Value);
+        break;
+      }
+      T1 = HAL_BenchTicks();
+      Print[m] += (HAL_Bench_t)(T1-T0);
+      if ((HAL_Bench_t)(T1-T0) > PrintMax[m]) {
+        PrintMax[m] = T1-T0;
+      }
+    }
+  }
+  for (uint8_t m = 0; m < 5; m++) {
+    tiny_printf("%s ticks per call %u max %u\n", Method[m], Print[m]/16, PrintMax[m]);
+    USARTP_FlushTX_Buffer();
+  }
+  tiny_printf("Command: End benchmark\n");
+  USARTP_FlushTX_Buffer();
 }
+#endif
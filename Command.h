@@ -13,6 +13,7 @@ extern "C" {
 void Command_Initialize(void);
 void Command_Scheduler(void);
 void Command_Handler(uint8_t *pBuffer, uint8_t Size);
+void Command_QueueScheduler(uint32_t Cycle);
 
 #ifdef __cplusplus
 }
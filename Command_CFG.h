@@ -6,10 +6,22 @@
 #define COMMAND_CFG_H_
 
 #define DEBUG_COMMAND
+//#define DEBUG_COMMAND_BENCHMARK // Per character receive time, disable DEBUG_COMMAND for meaningful numbers
 
 #include "USARTP.h"
 
 #define CMD_Write(c) USARTP_Write(c)
 #define CMD_Read(c) USARTP_Read(c)
+#define CMD_WriteFree() USARTP_WriteFree()
+
+// Largest answer of one command, ACK and a 4 byte reply in ASCII hex (#xxxxxxxx<LF>)
+// Command_Scheduler reads the next byte only when the protocol buffer has room for it, so answers are never cut
+#define CMD_ANSWER_MAX (1 + 1 + 2*4 + 1)
+
+#define CMD_QUEUE_SIZE 5 // Ring buffer, 4 commands can be queued
+
+// Dimmer cycles (half periods) without a byte that drop a binary frame, the byte after the gap starts a new command
+// A byte takes 1 mS at 9600 baud, a main loop pass may take DIMMER_LOOKAHEAD cycles (Dimmer_Config.h) while bytes wait in the USART buffer
+#define CMD_BIN_TIMEOUT (DIMMER_LOOKAHEAD + 2)
 
 #endif // COMMAND_CFG_H_
@@ -5,3 +5,6 @@
 #include "DaliLut.h"
 
 const PROGMEM uint16_t LUT_DALI[LUT_DALI_Size] = { 131, 4, 3, 4, 4, 4, 4, 5, 4, 5, 4, 5, 5, 5, 5, 5, 6, 5, 6, 6, 6, 7, 6, 7, 6, 7, 8, 7, 8, 7, 8, 9, 8, 9, 9, 9, 9, 10, 10, 10, 11, 10, 12, 11, 12, 12, 12, 13, 13, 13, 14, 15, 14, 15, 16, 15, 17, 16, 18, 17, 18, 19, 19, 20, 20, 21, 22, 22, 22, 23, 24, 25, 25, 26, 27, 27, 28, 29, 30, 30, 31, 33, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 44, 45, 46, 47, 48, 50, 52, 52, 54, 56, 57, 59, 60, 62, 64, 66, 67, 69, 72, 73, 75, 77, 79, 82, 84, 86, 88, 91, 94, 96, 99, 101, 104, 108, 110, 113, 116, 120, 122, 127, 129, 134, 137, 141, 144, 149, 153, 157, 161, 166, 171, 175, 180, 185, 190, 195, 201, 206, 212, 218, 224, 230, 237, 243, 250, 257, 263, 272, 278, 287, 294, 302, 311, 319, 329, 337, 347, 356, 366, 376, 387, 397, 409, 419, 432, 443, 455, 468, 482, 494, 508, 522, 537, 551, 567, 582, 599, 615, 632, 649, 668, 686, 705, 724, 745, 765, 787, 808, 830, 854, 877, 901, 927, 952, 978, 1005, 1034, 1062, 1091, 1121, 1153, 1184, 1217, 1251, 1286, 1321, 1358, 1395, 1434, 1473, 1514, 1557, 1599, 1644, 1689, 1736, 1783, 1834, 1884, 1936, 1990, 2044, 2102, 2159, 2220, 2280, 2344, 2409, 2476, 2544, 2614, 2687, 2761, 2838, 2916, 2996, 3080, 3165, 3253, 3343, 3435, 3530 };
+
+// Sum of LUT_DALI up to and including the row, bits 0..15, bit 16 is set from row LUT_DALI_Cumulative_Carry
+const PROGMEM uint16_t LUT_DALI_Cumulative[LUT_DALI_Size] = { 131, 135, 138, 142, 146, 150, 154, 159, 163, 168, 172, 177, 182, 187, 192, 197, 203, 208, 214, 220, 226, 233, 239, 246, 252, 259, 267, 274, 282, 289, 297, 306, 314, 323, 332, 341, 350, 360, 370, 380, 391, 401, 413, 424, 436, 448, 460, 473, 486, 499, 513, 528, 542, 557, 573, 588, 605, 621, 639, 656, 674, 693, 712, 732, 752, 773, 795, 817, 839, 862, 886, 911, 936, 962, 989, 1016, 1044, 1073, 1103, 1133, 1164, 1197, 1230, 1264, 1299, 1335, 1372, 1410, 1449, 1489, 1530, 1572, 1616, 1661, 1707, 1754, 1802, 1852, 1904, 1956, 2010, 2066, 2123, 2182, 2242, 2304, 2368, 2434, 2501, 2570, 2642, 2715, 2790, 2867, 2946, 3028, 3112, 3198, 3286, 3377, 3471, 3567, 3666, 3767, 3871, 3979, 4089, 4202, 4318, 4438, 4560, 4687, 4816, 4950, 5087, 5228, 5372, 5521, 5674, 5831, 5992, 6158, 6329, 6504, 6684, 6869, 7059, 7254, 7455, 7661, 7873, 8091, 8315, 8545, 8782, 9025, 9275, 9532, 9795, 10067, 10345, 10632, 10926, 11228, 11539, 11858, 12187, 12524, 12871, 13227, 13593, 13969, 14356, 14753, 15162, 15581, 16013, 16456, 16911, 17379, 17861, 18355, 18863, 19385, 19922, 20473, 21040, 21622, 22221, 22836, 23468, 24117, 24785, 25471, 26176, 26900, 27645, 28410, 29197, 30005, 30835, 31689, 32566, 33467, 34394, 35346, 36324, 37329, 38363, 39425, 40516, 41637, 42790, 43974, 45191, 46442, 47728, 49049, 50407, 51802, 53236, 54709, 56223, 57780, 59379, 61023, 62712, 64448, 695, 2529, 4413, 6349, 8339, 10383, 12485, 14644, 16864, 19144, 21488, 23897, 26373, 28917, 31531, 34218, 36979, 39817, 42733, 45729, 48809, 51974, 55227, 58570, 62005, 65535 };
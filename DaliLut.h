@@ -10,13 +10,16 @@ extern "C" {
 #endif
 
 #include <stdint.h>
-#include <avr/pgmspace.h>
+#include "HAL.h"
 
 #define LUT_DALI_Size  254
 #define LUT_DALI_Resolution   131072
 #define LUT_DALI_Resolution_2 65536
+#define LUT_DALI_Resolution_Bits 17 // LUT_DALI_Resolution = 1 << LUT_DALI_Resolution_Bits
+#define LUT_DALI_Cumulative_Carry 228 // First row of LUT_DALI_Cumulative with bit 16 set
 
 extern const uint16_t LUT_DALI[LUT_DALI_Size];
+extern const uint16_t LUT_DALI_Cumulative[LUT_DALI_Size];
 
 #ifdef __cplusplus
 }
@@ -2,14 +2,15 @@
  * Dimmer.c
  */
 
-#include "Arduino.h"
-#include <avr/io.h>
+#include "HAL.h"
 #include <stdio.h>
-#include <avr/interrupt.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "Dimmer_Config.h"
 #include "Dimmer.h"
 #include "DaliLut.h"
+#include "FadeLut.h"
 #include "TinyPrintf.h"
 
 #if defined(DEBUG_DIMMER)
@@ -18,12 +19,6 @@
 #define debug_tiny_printf(str,...)
 #endif
 
-#if defined(DEBUG_DIMMER_DALI)
-#define debug_dali_tiny_printf(...) tiny_printf(__VA_ARGS__)
-#else
-#define debug_dali_tiny_printf(str,...)
-#endif
-
 typedef enum {
   DimmerModeOff = 0,
   DimmerModeOn = 1,
@@ -42,36 +37,198 @@ typedef struct {
   uint32_t CurrentCycle;
   uint32_t StartCycle;
   uint32_t EndCycle;
-  uint32_t DeltaCycle;
+  uint32_t DeltaCycle;   // Of the fade, the DDA divisor (Cycles) of a rate fade
+  uint32_t RemainingCycle;
+  uint16_t FadePosition; // Brightness moved since StartBrightness, 8.8 fixed point (integer DALI steps . interpolation fraction)
+  uint8_t  FadeProfile;  // Dimmer_Profile_t
+  uint16_t FadeProgress; // DDA, FadePosition when linear, else the time part done 0..65535 of the easing curve
+  uint16_t FadeStep;     // FadeProgress increment per cycle, FadeRange/DeltaCycle
+  uint32_t FadeStepRem;  // FadeRange%DeltaCycle, accumulated in FadeError
+  uint32_t FadeError;
   uint16_t CurrentOCR;
+  uint8_t  Leader;       // Channel that calculates the fade, itself unless it follows a synchronized fade
+  uint8_t  DitherError;  // Fraction of a tick carried to the next half period (DIMMER_DITHERING)
 } Dimmer_t;
+// Fade fields copied from a leader, all fields before CurrentOCR
+#define DIMMER_FADE_STATE offsetof(Dimmer_t, CurrentOCR)
 static volatile Dimmer_t Dimmer[DimmerMAX];
 
+// Fade sequence of a channel, the next keyframe is started by Dimmer_Scheduler when a fade is done
+typedef struct {
+  Dimmer_Keyframe_t Keyframe[DIMMER_SEQUENCE_SIZE];
+  uint8_t Count;   // Keyframes, 0 when no sequence is running
+  uint8_t Index;   // Keyframe being faded to
+  uint8_t Loop;    // After the last keyframe start again with the first
+  uint8_t Profile; // Dimmer_Profile_t of all keyframes
+} Dimmer_Sequence_t;
+static Dimmer_Sequence_t Dimmer_Sequence[DimmerMAX];
+
 typedef struct {
   uint8_t Enable;
-  int16_t NextPulseValue[2];
-  uint8_t NextPulseValueSemaphore;
   uint8_t State;
 } Dimmer_OCR_t;
 static volatile Dimmer_OCR_t DimmerOCR[DimmerMAX];
 
-static volatile uint16_t DaliTable[LUT_DALI_Size];
+// Lookahead ring, Dimmer_Scheduler calculates the firing values up to DIMMER_LOOKAHEAD half periods ahead
+// Dimmer_AheadIrq is the slot in use by the capture Irq, Dimmer_AheadHead the next slot to fill, full when they are equal
+#define DIMMER_AHEAD_SLOTS (DIMMER_LOOKAHEAD + 1)
+#if !defined(DIMMER_SORTED_SCHEDULER)
+typedef struct {
+  uint16_t OCR[DimmerMAX]; // Scaled to the tracked half period
+  uint8_t  Enable;         // Bit per channel
+} Dimmer_Ahead_t;
+static volatile Dimmer_Ahead_t Dimmer_Ahead[DIMMER_AHEAD_SLOTS];
+#endif
+static volatile uint8_t Dimmer_AheadHead = 1;
+static volatile uint8_t Dimmer_AheadIrq = 0;
+static volatile uint8_t Dimmer_UnderrunCountIrq = 0;
+static uint32_t Dimmer_AheadCycle = 0; // Cycle of the newest slot, the fades are calculated up to this cycle
+
+#if defined(DIMMER_SORTED_SCHEDULER)
+// One gate action of the firing list, all channels with (about) the same time share an event
+typedef struct {
+  uint16_t Time;
+  uint8_t  SetB;
+  uint8_t  SetD;
+  uint8_t  ClearB;
+  uint8_t  ClearD;
+} Dimmer_Event_t;
+
+typedef struct {
+  uint8_t Count;
+  Dimmer_Event_t Event[DimmerMAX*2];
+} Dimmer_EventList_t;
+
+// A list per slot of the lookahead ring, the scheduler builds the list of Dimmer_AheadHead
+static volatile Dimmer_EventList_t DimmerEventList[DIMMER_AHEAD_SLOTS];
+static volatile uint8_t DimmerEventIndex = 0;
+
+static const uint8_t Dimmer_GatePortB[8] = DIMMER_GATE_PORTB;
+static const uint8_t Dimmer_GatePortD[8] = DIMMER_GATE_PORTD;
+static uint8_t Dimmer_GateMaskB = 0;
+static uint8_t Dimmer_GateMaskD = 0;
+#endif
 
 static volatile uint16_t Dimmer_CurrentPulsePeriod = 0;
 static volatile uint8_t  Dimmer_CurrentCountIrq = 0;
+static volatile uint8_t  Dimmer_RejectCountIrq = 0;
+static volatile uint8_t  Dimmer_CaptureWindow = DIMMER_CAPTURE_MIN >> 8; // High byte of the earliest TCNT1 of a zero crossing
+#if defined(DIMMER_PREDICTIVE_FIRING)
+static volatile uint16_t Dimmer_PredictPeriod = 0; // Tracked half period for the capture Irq, 0 without lock
+static volatile int16_t  Dimmer_ZeroOffset = DIMMER_DETECTOR_OFFSET; // Ticks from the edge to the predicted zero crossing
+static uint32_t Dimmer_ZeroPeriod = 0; // Half period of the prediction, 16.8 fixed point, 0 starts from Dimmer_PredictPeriod
+#define DIMMER_FIRE(OCR) Dimmer_FireOCR(OCR, Offset)
+#else
+#define DIMMER_FIRE(OCR) (OCR)
+#endif
 static volatile uint8_t  Dimmer_CaptureFlag = 0;
 static volatile uint32_t Dimmer_CurrentCycle = 0;
 
+// The calibration (RangeMin/RangeMax) is in ticks of a half period of ExternalDimmer_MAINS_HZ
+// Firing times are scaled with the tracked half period, so the phase angle follows the grid
+#define DIMMER_SCALE_ONE 32768 // 1.15 fixed point
+static uint16_t Dimmer_HalfPeriod = 20000; // Tracked, or of ExternalDimmer_MAINS_HZ without lock
+static uint16_t Dimmer_PeriodScale = DIMMER_SCALE_ONE;
+
 
 void Dimmer_CalcFade(Dimmer_Select_t Select, uint32_t CurrentCount);
+static void Dimmer_FadeAdvance(Dimmer_Select_t Select, uint32_t Elapsed);
+static void Dimmer_FadeInterpolate(Dimmer_Select_t Select);
+static inline uint16_t Dimmer_FadeTicks(Dimmer_Select_t Select, uint16_t DeltaDali, uint8_t Fraction);
+static uint16_t Dimmer_FadeEase(Dimmer_Select_t Select);
+static void Dimmer_StartFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness, Dimmer_Profile_t Profile);
+static void Dimmer_SequenceNext(Dimmer_Select_t Select);
+static void Dimmer_FadeLeader(Dimmer_Select_t Select);
+static void Dimmer_FadeFollow(Dimmer_Select_t Select);
+static void Dimmer_FadeDetach(Dimmer_Select_t Select);
+static uint16_t Dimmer_DaliOCR(Dimmer_Select_t Select, uint8_t Brightness);
+static void Dimmer_UpdatePeriod(void);
+static inline uint16_t Dimmer_ScaleOCR(uint16_t OCR);
+#if defined(DIMMER_SORTED_SCHEDULER)
+static uint16_t Dimmer_BuildEventList(uint8_t List);
+#endif
+#if defined(DEBUG_DIMMER_BENCHMARK)
+void Dimmer_Benchmark(void);
+#endif
+
+#if defined(DIMMER_PREDICTIVE_FIRING)
+// Ticks from the captured edge to the zero crossing of this half period
+// Second order loop: Error is the edge against the predicted zero crossing (plus the detector offset)
+//  the prediction moves 1/2^DIMMER_PREDICT_SHIFT of Error towards the edge, the half period 1/256 of Error
+static inline int16_t Dimmer_PredictZero(uint16_t Period) {
+  int16_t Error;
+  int16_t Offset = DIMMER_DETECTOR_OFFSET;
+
+  if (Dimmer_PredictPeriod == 0) {
+    Dimmer_ZeroPeriod = 0; // No lock, relative to the edge
+  } else if (Dimmer_ZeroPeriod == 0) {
+    Dimmer_ZeroPeriod = (uint32_t)Dimmer_PredictPeriod << 8;
+  } else {
+    Error = (int16_t)(Period - (uint16_t)(Dimmer_ZeroPeriod >> 8)) - (Dimmer_ZeroOffset - DIMMER_DETECTOR_OFFSET);
+    if ((Error > DIMMER_PREDICT_MAX) || (Error < -DIMMER_PREDICT_MAX)) {
+      Dimmer_ZeroPeriod = (uint32_t)Dimmer_PredictPeriod << 8; // Lost, start again from the edge
+    } else {
+      Dimmer_ZeroPeriod += Error;
+      Offset -= Error - (Error >> DIMMER_PREDICT_SHIFT);
+    }
+  }
+  Dimmer_ZeroOffset = Offset;
+  return Offset;
+}
+
+// Compare value of a firing time after the zero crossing
+static inline uint16_t Dimmer_FireOCR(uint16_t OCR, int16_t Offset) {
+  OCR += Offset;
+  if ((int16_t)OCR < DIMMER_PREDICT_MIN_OCR) {
+    OCR = DIMMER_PREDICT_MIN_OCR;
+  }
+  return OCR;
+}
+#endif
+
+// Slot of the lookahead ring for the new half period
+// The same slot again when Dimmer_Scheduler did not fill the next one in time (an underrun)
+static inline uint8_t Dimmer_AheadNext(void) {
+  uint8_t Slot = Dimmer_AheadIrq + 1;
+
+  if (Slot == DIMMER_AHEAD_SLOTS) {
+    Slot = 0;
+  }
+  if (Slot == Dimmer_AheadHead) {
+    Dimmer_UnderrunCountIrq++;
+    return Dimmer_AheadIrq;
+  }
+  Dimmer_AheadIrq = Slot;
+  return Slot;
+}
 
+#if !defined(DIMMER_SORTED_SCHEDULER)
 ISR(TIMER1_CAPT_vect) {
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  uint16_t Period = ICR1; // Edge, without the Irq latency
+  int16_t Offset;
+#else
+  uint16_t Period = TCNT1;
+#endif
+  volatile Dimmer_Ahead_t *pAhead;
+  // Glitch rejection, an edge before the window is noise: no new cycle, Timer1 and the gates keep running
+  // Bounded, an 8 bit compare of the high byte and an 8 bit increment
+  if ((uint8_t)(Period >> 8) < Dimmer_CaptureWindow) {
+    Dimmer_RejectCountIrq++;
+    return;
+  }
   ExternalDebugPinCAPT_Set;
   
-  Dimmer_CurrentPulsePeriod = TCNT1;
+  Dimmer_CurrentPulsePeriod = Period;
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  TCNT1 -= Period; // Counts from the edge
+  Offset = Dimmer_PredictZero(Period);
+#else
   TCNT1 = 0;
+#endif
+  pAhead = &Dimmer_Ahead[Dimmer_AheadNext()];
 
-  if (DimmerOCR[Dimmer0].Enable == 0) {
+  if ((pAhead->Enable & (1<<Dimmer0)) == 0) {
     // OCR output is being disabled
     TCCR1A &= ~((1<<COM1A1)+(1<<COM1A0));
     TIMSK1 &= ~(1<<OCIE1A);
@@ -79,15 +236,11 @@ ISR(TIMER1_CAPT_vect) {
     // OCR (is enabled) will be set on next compare
     TCCR1A |= ((1<<COM1A1)+(1<<COM1A0));
     TIMSK1 |= (1<<OCIE1A);
-    if (DimmerOCR[0].NextPulseValueSemaphore == 0) {
-      OCR1A = (uint16_t)DimmerOCR[Dimmer0].NextPulseValue[0];
-    } else {
-      OCR1A = (uint16_t)DimmerOCR[Dimmer0].NextPulseValue[1];
-    }
+    OCR1A = DIMMER_FIRE(pAhead->OCR[Dimmer0]);
   }
   DimmerOCR[Dimmer0].State = 0;
   
-  if (DimmerOCR[Dimmer1].Enable == 0) {
+  if ((pAhead->Enable & (1<<Dimmer1)) == 0) {
     // OCR output is being disabled
     TCCR1A &= ~((1<<COM1B1)+(1<<COM1B0));
     TIMSK1 &= ~(1<<OCIE1B);
@@ -95,11 +248,7 @@ ISR(TIMER1_CAPT_vect) {
     // OCR (is enabled) will be set on next compare
     TCCR1A |= ((1<<COM1B1)+(1<<COM1B0));
     TIMSK1 |= (1<<OCIE1B);
-    if (DimmerOCR[Dimmer1].NextPulseValueSemaphore == 0) {
-      OCR1B = (uint16_t)DimmerOCR[Dimmer1].NextPulseValue[0];
-    } else {
-      OCR1B = (uint16_t)DimmerOCR[Dimmer1].NextPulseValue[1];
-    }
+    OCR1B = DIMMER_FIRE(pAhead->OCR[Dimmer1]);
   }
   DimmerOCR[Dimmer1].State = 0;
 
@@ -145,6 +294,88 @@ ISR(TIMER1_COMPB_vect) {
 
   ExternalDebugPinOCRB_Clear;
 }
+#else
+ISR(TIMER1_CAPT_vect) {
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  uint16_t Period = ICR1; // Edge, without the Irq latency
+  int16_t Offset;
+#else
+  uint16_t Period = TCNT1;
+#endif
+  uint8_t List;
+  // Glitch rejection, an edge before the window is noise: no new cycle, Timer1 and the gates keep running
+  // Bounded, an 8 bit compare of the high byte and an 8 bit increment
+  if ((uint8_t)(Period >> 8) < Dimmer_CaptureWindow) {
+    Dimmer_RejectCountIrq++;
+    return;
+  }
+  ExternalDebugPinCAPT_Set;
+  
+  Dimmer_CurrentPulsePeriod = Period;
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  TCNT1 -= Period; // Counts from the edge
+  Offset = Dimmer_PredictZero(Period);
+#else
+  TCNT1 = 0;
+#endif
+
+  // No gate stays on over a zero crossing
+  PORTB &= ~Dimmer_GateMaskB;
+  PORTD &= ~Dimmer_GateMaskD;
+
+  List = Dimmer_AheadNext();
+  DimmerEventIndex = 0;
+  if (DimmerEventList[List].Count == 0) {
+    TIMSK1 &= ~(1<<OCIE1A);
+  } else {
+    OCR1A = DIMMER_FIRE(DimmerEventList[List].Event[0].Time);
+    TIMSK1 |= (1<<OCIE1A);
+  }
+
+  // Clear all interrupt flags
+  TIFR1   = (1<<ICF1) + (1<<OCF1A);
+
+  ExternalDebugPinCAPT_Clear1;
+  
+  Dimmer_CurrentCountIrq++; // The actualCounter outside the interrupt is 32 bit and is updated with this counter
+  Dimmer_CaptureFlag = 1; // Allow new calulcation round
+  
+  ExternalDebugPinCAPT_Clear2; 
+}
+
+// One event per Irq, events are at least DIMMER_EVENT_MIN_TICKS apart so the next compare cannot be missed
+ISR(TIMER1_COMPA_vect) {
+  volatile Dimmer_Event_t *pEvent;
+  uint8_t Index;
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  uint16_t Time;
+#endif
+  ExternalDebugPinOCRA_Set;
+
+  Index = DimmerEventIndex;
+  pEvent = &DimmerEventList[Dimmer_AheadIrq].Event[Index];
+  PORTB = (PORTB | pEvent->SetB) & ~pEvent->ClearB;
+  PORTD = (PORTD | pEvent->SetD) & ~pEvent->ClearD;
+  Index++;
+  if (Index < DimmerEventList[Dimmer_AheadIrq].Count) {
+#if defined(DIMMER_PREDICTIVE_FIRING)
+    // Clamped as the first event, and at least DIMMER_EVENT_MIN_TICKS after this one (when this one was clamped)
+    Time = Dimmer_FireOCR(pEvent[1].Time, Dimmer_ZeroOffset);
+    if ((int16_t)(Time - OCR1A) < DIMMER_EVENT_MIN_TICKS) {
+      Time = OCR1A + DIMMER_EVENT_MIN_TICKS;
+    }
+    OCR1A = Time;
+#else
+    OCR1A = pEvent[1].Time;
+#endif
+  } else {
+    TIMSK1 &= ~(1<<OCIE1A);
+  }
+  DimmerEventIndex = Index;
+
+  ExternalDebugPinOCRA_Clear;
+}
+#endif
 
 void Dimmer_Initialize(void) {
   debug_tiny_printf("Dimmer: Begin init\n");
@@ -153,36 +384,52 @@ void Dimmer_Initialize(void) {
   
   DDRB &= ~(1<<DDB0); // Input D8
 
+#if !defined(DIMMER_SORTED_SCHEDULER)
   DDRB |= (1<<DDB1); // Output D9
   PORTB &= ~(1<<PORTB1); // Clear D9
 
   DDRB |= (1<<DDB2); // Output D10
   PORTB &= ~(1<<PORTB2); // Clear D10 
+  Dimmer_Ahead[0].Enable = 0; // In use by the capture Irq until the first slot is filled
+#else
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    Dimmer_GateMaskB |= Dimmer_GatePortB[i];
+    Dimmer_GateMaskD |= Dimmer_GatePortD[i];
+  }
+  DDRB |= Dimmer_GateMaskB; // Gate outputs
+  PORTB &= ~Dimmer_GateMaskB;
+  DDRD |= Dimmer_GateMaskD;
+  PORTD &= ~Dimmer_GateMaskD;
+  for (uint8_t i = 0; i < DIMMER_AHEAD_SLOTS; i++) {
+    DimmerEventList[i].Count = 0;
+  }
+#endif
 // TODO move, not part of Dimmer
   ExternalDebugPinCAPT_Init;
   ExternalDebugPinOCRA_Init;
   ExternalDebugPinOCRA_Init;
 
-  DimmerOCR[Dimmer0].Enable = 0;
-  DimmerOCR[Dimmer0].NextPulseValue[0] = ExternalDimmer_RangeDefault;
-  DimmerOCR[Dimmer0].NextPulseValue[1] = DimmerOCR[Dimmer0].NextPulseValue[0];
-  DimmerOCR[Dimmer0].NextPulseValueSemaphore = 0;
-  DimmerOCR[Dimmer0].State = 0;
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    DimmerOCR[i].Enable = 0;
+    DimmerOCR[i].State = 0;
 
-  DimmerOCR[Dimmer1].Enable = 0;
-  DimmerOCR[Dimmer1].NextPulseValue[0] = ExternalDimmer_RangeDefault;
-  DimmerOCR[Dimmer1].NextPulseValue[1] = DimmerOCR[Dimmer1].NextPulseValue[0];
-  DimmerOCR[Dimmer1].NextPulseValueSemaphore = 0;
-  DimmerOCR[Dimmer1].State = 0;
-
-  Dimmer[Dimmer0].Mode = DimmerModeOff;
-  Dimmer[Dimmer0].CurrentBrightness = 0;
-  Dimmer[Dimmer1].Mode = DimmerModeOff;
-  Dimmer[Dimmer1].CurrentBrightness = 0;
+    Dimmer[i].Mode = DimmerModeOff;
+    Dimmer[i].CurrentBrightness = 0;
+    Dimmer[i].CurrentOCR = 0;
+    Dimmer[i].Leader = i;
+    Dimmer[i].DitherError = 0;
+    Dimmer_Sequence[i].Count = 0;
+  }
+  Dimmer_UpdatePeriod();
  
+#if !defined(DIMMER_SORTED_SCHEDULER)
   // Clear OCR1A and OCR1B
   TCCR1A = (1<<COM1A1) + (1<<COM1B1);
   TCCR1C = (1<<FOC1A) + (1<<FOC1B);
+#else
+  // Gates are GPIOs, OC1A and OC1B disconnected
+  TCCR1A = 0;
+#endif
   // Input Capture Noise Canceler
   // Input Capture Rising Edge
   // Timer clock = I/O clock / 8
@@ -191,13 +438,36 @@ void Dimmer_Initialize(void) {
 	// Clear pending interrupts Input Capture, OCR1A and OCR1B
   TIFR1   = (1<<ICF1) + (1<<OCF1A) + (1<<OCF1B);
 
+#if defined(DEBUG_DIMMER_DALI)
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    tiny_printf("Dimmer: Begin show Dali curve %u\n", i);
+    for (uint16_t Brightness = 1; Brightness <= LUT_DALI_Size; Brightness++) {
+      tiny_printf("%u %u\n", Brightness, Dimmer_DaliOCR((Dimmer_Select_t)i, Brightness));
+      USARTP_FlushTX_Buffer();
+    }
+    tiny_printf("Dimmer: End show Dali curve\n");
+  }
+#endif
+
+#if defined(DEBUG_DIMMER_BENCHMARK)
+  Dimmer_Benchmark(); // Timer1 is running, but no Irqs are enabled yet
+#endif
+
+#if !defined(DIMMER_SORTED_SCHEDULER)
 	// Enable Timer 1 Capture Event, OCR1A and OCR1B Interrupt
 	TIMSK1  = (1<<ICIE1) + (1<<OCIE1A) + (1<<OCIE1B);
+#else
+	// Enable Timer 1 Capture Event, OCR1A is enabled by the capture when there are events
+	TIMSK1  = (1<<ICIE1);
+#endif
   debug_tiny_printf("Dimmer: End init\n");
 }
 
 void Dimmer_Scheduler(void) {
   uint8_t LocalCount;
+  uint8_t Slot;
+  uint32_t Cycle;
+
   if (Dimmer_CaptureFlag != 0) {  
     Dimmer_CaptureFlag =  0;
     // Atomic actions are only possible for 8 bit actions
@@ -206,20 +476,39 @@ void Dimmer_Scheduler(void) {
     LocalCount = Dimmer_CurrentCountIrq;
     Dimmer_CurrentCountIrq -= LocalCount;
     Dimmer_CurrentCycle += LocalCount;
-
-    switch (Dimmer[Dimmer0].Mode) {
-    default:
-    case DimmerModeOff:
-      break;
-    case DimmerModeOn:
-      break;
-    case DimmerModeFadeDown:
-    case DimmerModeFadeUp:  
-      Dimmer_CalcFade(Dimmer0, Dimmer_CurrentCycle);
-      break;
+    LocalCount = Dimmer_UnderrunCountIrq;
+    if (LocalCount != 0) {
+      Dimmer_UnderrunCountIrq -= LocalCount;
+      ExternalDimmer_MissedCyclesHook(LocalCount);
+    }
+    LocalCount = Dimmer_RejectCountIrq;
+    if (LocalCount != 0) {
+      Dimmer_RejectCountIrq -= LocalCount;
+      ExternalDimmer_RejectedHook(LocalCount);
     }
 
-    switch (Dimmer[Dimmer1].Mode) {
+    // The next capture is a half period away, Dimmer_CurrentPulsePeriod is stable
+    ExternalDimmer_MainsUpdate(Dimmer_CurrentPulsePeriod);
+    Dimmer_UpdatePeriod();
+  }
+
+  // Lookahead, one half period per call while the ring has room
+  // The ring is filled in the loop passes between the captures, so a slow pass does not cost a step
+  Slot = Dimmer_AheadHead;
+  if (Slot == Dimmer_AheadIrq) {
+    return; // Full
+  }
+  Cycle = Dimmer_AheadCycle + 1;
+  if ((int32_t)(Dimmer_CurrentCycle - Cycle) >= 0) {
+    // The ring ran empty, the capture of Dimmer_CurrentCycle has happened, the slot is for the next one
+    Cycle = Dimmer_CurrentCycle + 1;
+  }
+  Dimmer_AheadCycle = Cycle;
+
+  ExternalDimmer_CycleHook(Cycle);
+
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    switch (Dimmer[i].Mode) {
     default:
     case DimmerModeOff:
       break;
@@ -227,82 +516,156 @@ void Dimmer_Scheduler(void) {
       break;
     case DimmerModeFadeDown:
     case DimmerModeFadeUp:  
-      Dimmer_CalcFade(Dimmer1, Dimmer_CurrentCycle);
+      if (Dimmer[i].Leader != i) {
+        Dimmer_FadeFollow((Dimmer_Select_t)i); // The leader has a lower index, it is calculated already
+      } else {
+        Dimmer_CalcFade((Dimmer_Select_t)i, Cycle);
+      }
       break;
     }
+    // Also a follower that got the finished fade of its leader (Dimmer_FadeDetach)
+    if ((Dimmer[i].Mode == DimmerModeFadePostAction) && (Dimmer_Sequence[i].Count != 0)) {
+      Dimmer_SequenceNext((Dimmer_Select_t)i); // Without a cycle in between, so without a step in the fade
+    }
+  }
 // ****
-    //if the semaphore is active, the backup (1) is read in the interupt, otherwise the main (0)
-    for (uint8_t i = 0; i < DimmerMAX; i++) {
-      DimmerOCR[i].NextPulseValueSemaphore = 1;
-      DimmerOCR[i].NextPulseValue[0] = Dimmer[i].CurrentOCR;
-      DimmerOCR[i].NextPulseValueSemaphore = 0;
-      DimmerOCR[i].NextPulseValue[1] = Dimmer[i].CurrentOCR;
+#if !defined(DIMMER_SORTED_SCHEDULER)
+  LocalCount = 0;
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    Dimmer_Ahead[Slot].OCR[i] = Dimmer_ScaleOCR(Dimmer[i].CurrentOCR);
+    // OCR 0 is off (Dali 0, SetTimerValue 0), also with predictive firing that raises a compare value to DIMMER_PREDICT_MIN_OCR
+    if ((DimmerOCR[i].Enable != 0) && (Dimmer[i].CurrentOCR != 0)) {
+      LocalCount |= (1<<i);
     }
+  }
+  Dimmer_Ahead[Slot].Enable = LocalCount;
+#else
+  Dimmer_BuildEventList(Slot);
+#endif
+  // Published, the capture Irq can use the slot from now on
+  Slot++;
+  if (Slot == DIMMER_AHEAD_SLOTS) {
+    Slot = 0;
+  }
+  Dimmer_AheadHead = Slot;
 
 #if defined(DEBUG_DIMMER_DEMO)
-    if (Dimmer[Dimmer0].Mode == DimmerModeFadePostAction) {
-      if (Dimmer[Dimmer0].CurrentBrightness < 128) {
-        Dimmer_SetFade(Dimmer0, 20000, 254);
-      } else {
-        Dimmer_SetFade(Dimmer0, 20000, 1);
-      }
-    }
-    if (Dimmer[Dimmer1].Mode == DimmerModeFadePostAction) {
-      if (Dimmer[Dimmer1].CurrentBrightness < 128) {
-        Dimmer_SetFade(Dimmer1, 20000, 254);
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    if (Dimmer[i].Mode == DimmerModeFadePostAction) {
+      if (Dimmer[i].CurrentBrightness < 128) {
+        Dimmer_SetFade((Dimmer_Select_t)i, 20000, 254);
       } else {
-        Dimmer_SetFade(Dimmer1, 20000, 1);
+        Dimmer_SetFade((Dimmer_Select_t)i, 20000, 1);
       }
     }
-#endif
   }
+#endif
 }
 
-void Dimmer_UpdateDaliTable(uint16_t TriacPulseMin, uint16_t TriacPulseMax) {
-  uint32_t DaliValue = 0;
-  uint16_t Value16 = 0;
-  uint32_t Value32 = 0;
-  uint16_t TriacPulseDelta;
+#if defined(DIMMER_SORTED_SCHEDULER)
+// Adds a gate action to the sorted list, merged into an existing event when closer than DIMMER_EVENT_MIN_TICKS
+// Returns the firing time error caused by merging
+static uint16_t Dimmer_InsertEvent(Dimmer_EventList_t *pList, uint16_t Time, uint8_t SetB, uint8_t SetD, uint8_t ClearB, uint8_t ClearD) {
+  uint8_t i;
+  uint8_t j;
+  Dimmer_Event_t *pEvent;
+
+  for (i = 0; i < pList->Count; i++) {
+    pEvent = &pList->Event[i];
+    if ((uint16_t)(Time - pEvent->Time + (DIMMER_EVENT_MIN_TICKS-1)) < (2*DIMMER_EVENT_MIN_TICKS-1)) {
+      pEvent->SetB |= SetB;
+      pEvent->SetD |= SetD;
+      pEvent->ClearB |= ClearB;
+      pEvent->ClearD |= ClearD;
+      return (Time > pEvent->Time) ? (Time - pEvent->Time) : (pEvent->Time - Time);
+    }
+    if (Time < pEvent->Time) {
+      break;
+    }
+  }
+  for (j = pList->Count; j > i; j--) {
+    pList->Event[j] = pList->Event[j-1];
+  }
+  pEvent = &pList->Event[i];
+  pEvent->Time = Time;
+  pEvent->SetB = SetB;
+  pEvent->SetD = SetD;
+  pEvent->ClearB = ClearB;
+  pEvent->ClearD = ClearD;
+  pList->Count++;
+  return 0;
+}
 
-  debug_dali_tiny_printf("Dimmer: Begin update Dali table");
+// Sorted firing list of a half cycle in slot List (not in use by the Irq), gate on at CurrentOCR and off a pulse width later
+// Returns the worst firing time error of the list
+static uint16_t Dimmer_BuildEventList(uint8_t List) {
+  Dimmer_EventList_t *pList;
+  uint16_t Time;
+  uint16_t Error;
+  uint16_t MaxError = 0;
 
+  pList = (Dimmer_EventList_t *)&DimmerEventList[List];
+  pList->Count = 0;
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    if ((DimmerOCR[i].Enable == 0) || (Dimmer[i].CurrentOCR == 0)) {
+      continue;
+    }
+    Time = Dimmer_ScaleOCR(Dimmer[i].CurrentOCR);
+    Error = Dimmer_InsertEvent(pList, Time, Dimmer_GatePortB[i], Dimmer_GatePortD[i], 0, 0);
+    if (Error > MaxError) {
+      MaxError = Error;
+    }
+    Error = Dimmer_InsertEvent(pList, Time + DimmerOCR_Calc_uS(Dimmer_PulseWidth), 0, 0, Dimmer_GatePortB[i], Dimmer_GatePortD[i]);
+    if (Error > MaxError) {
+      MaxError = Error;
+    }
+  }
+  return MaxError;
+}
+#endif
 
-  TriacPulseDelta = TriacPulseMax - TriacPulseMin;
-  
-  // Value = DimmerMAX_RANGE - ((Dimmer_DELTA*DaliValue) + (LUT_DALI_Resolution/2))/LUT_DALI_Resolution
-  for (uint8_t i=0; i< LUT_DALI_Size; i++) {
-    DaliValue += pgm_read_word_near(LUT_DALI+i);
+// Half period and firing time scale of the tracked mains, once per cycle
+static void Dimmer_UpdatePeriod(void) {
+  uint16_t Nominal = (uint16_t)(1000000UL / ExternalDimmer_MAINS_HZ);
 
-    Value32 =  (uint32_t)TriacPulseDelta * (uint32_t)DaliValue + (uint32_t)LUT_DALI_Resolution_2; 
-    Value32 += (uint32_t)LUT_DALI_Resolution_2;
-    Value16 = Value32 / (uint32_t)LUT_DALI_Resolution;
-    DaliTable[i] = TriacPulseMax - Value16;
+  Dimmer_HalfPeriod = ExternalDimmer_MainsHalfPeriod();
+  if (Dimmer_HalfPeriod == 0) {
+    Dimmer_HalfPeriod = Nominal;
   }
+  Dimmer_PeriodScale = (uint16_t)((((uint32_t)Dimmer_HalfPeriod << 15) + Nominal / 2) / Nominal);
+#if defined(DIMMER_PREDICTIVE_FIRING)
+  // Written a half period before the capture Irq reads it
+  Dimmer_PredictPeriod = ExternalDimmer_MainsHalfPeriod();
+#endif
+  // 8 bit, so the capture Irq reads it atomically
+  if (ExternalDimmer_MainsHalfPeriod() != 0) {
+    Dimmer_CaptureWindow = (Dimmer_HalfPeriod - Dimmer_HalfPeriod / DIMMER_CAPTURE_WINDOW) >> 8;
+  } else {
+    Dimmer_CaptureWindow = DIMMER_CAPTURE_MIN >> 8;
+  }
+}
 
-  debug_dali_tiny_printf("Dimmer: End update Dali table\n");
+// Firing time of a calibrated OCR value in the tracked half period, the same value at the calibrated mains
+static inline uint16_t Dimmer_ScaleOCR(uint16_t OCR) {
+  return (uint16_t)(((uint32_t)OCR * Dimmer_PeriodScale + (DIMMER_SCALE_ONE / 2)) >> 15);
+}
 
+// OCR value of Brightness 1..254 with the calibration of the channel, there is no table in RAM
+// Value = RangeMax - ((RangeMax-RangeMin)*Cumulative + LUT_DALI_Resolution)/LUT_DALI_Resolution
+//  Cumulative is the sum of LUT_DALI up to Brightness (17 bits), one multiplication and a shift
+static uint16_t Dimmer_DaliOCR(Dimmer_Select_t Select, uint8_t Brightness) {
+  uint16_t RangeMax = ExternalDimmer_RangeMax(Select);
+  uint16_t RangeDelta = RangeMax - ExternalDimmer_RangeMin(Select);
+  uint32_t Cumulative;
 
-  #if defined(DEBUG_DIMMER_DALI)
-  tiny_printf("Dimmer: Begin show Dali table\n");
-  for (uint8_t i=0; i< LUT_DALI_Size; i++) {
-    tiny_printf(i);
-    tiny_printf(" ");
-    tiny_printf(DaliTable[i]);
-    tiny_printf("/n");
+  Cumulative = pgm_read_word_near(LUT_DALI_Cumulative + Brightness - 1);
+  if (Brightness > LUT_DALI_Cumulative_Carry) {
+    Cumulative += 0x10000UL;
   }
-  tiny_printf("Dimmer: End show Dali table\n");
-  #endif
+  return RangeMax - (uint16_t)(((uint32_t)RangeDelta * Cumulative + LUT_DALI_Resolution) >> LUT_DALI_Resolution_Bits);
 }
 
 void Dimmer_CalcFade(Dimmer_Select_t Select, uint32_t CurrentCount) {
-  uint32_t DurationDone;
-  uint16_t Value16;
-  uint32_t Value32; 
-  int16_t CurrentBrightness;
-  uint16_t OCR_Value;
-  uint16_t  DeltaDali;
-  uint8_t DeltaCurrentBrightness;
-  
   PORTB |= (1<<PORTB3); // Set D11
   
   if ((Dimmer[Select].Mode != DimmerModeFadeUp) && (Dimmer[Select].Mode != DimmerModeFadeDown)) {
@@ -310,23 +673,97 @@ void Dimmer_CalcFade(Dimmer_Select_t Select, uint32_t CurrentCount) {
     return; // not fading at the moment
   }
 
-  if (Dimmer[Select].StartCycle < Dimmer[Select].EndCycle) {
-    if ((CurrentCount < Dimmer[Select].StartCycle) || (CurrentCount > Dimmer[Select].EndCycle)) {
-      CurrentCount = Dimmer[Select].EndCycle;
-    } 
-  } else {
-    if ((CurrentCount < Dimmer[Select].StartCycle) && (CurrentCount > Dimmer[Select].EndCycle)) {
-      CurrentCount = Dimmer[Select].EndCycle;
+  // Normally 1 cycle elapsed, more if the main loop was too late for a capture
+  Dimmer_FadeAdvance(Select, CurrentCount - Dimmer[Select].CurrentCycle);
+  Dimmer[Select].CurrentCycle = CurrentCount;
+  Dimmer_FadeInterpolate(Select);
+
+  // Check if done with fade
+  if (Dimmer[Select].RemainingCycle == 0) {
+    Dimmer[Select].Mode = DimmerModeFadePostAction;
+    debug_tiny_printf("Done with Fade\n");
+  }
+  PORTB &= ~(1<<PORTB3);  // Clear D11
+}
+
+// Synchronized fades, a fade started in the same cycle with the same brightnesses, time and profile
+// as a fade of a lower channel follows that fade (the leader), for example all channels of a group command
+// A follower copies the brightness and fraction of its leader, only the calibration (Dimmer_FadeInterpolate) is its own
+static void Dimmer_FadeLeader(Dimmer_Select_t Select) {
+  volatile Dimmer_t *pDimmer = &Dimmer[Select];
+  volatile Dimmer_t *pLeader;
+
+  if ((pDimmer->Mode != DimmerModeFadeUp) && (pDimmer->Mode != DimmerModeFadeDown)) {
+    return;
+  }
+  for (uint8_t i = 0; i < Select; i++) {
+    pLeader = &Dimmer[i];
+    if ((pLeader->Leader == i) && (pLeader->Mode == pDimmer->Mode) &&
+        (pLeader->StartCycle == pDimmer->StartCycle) && (pLeader->RemainingCycle == pDimmer->RemainingCycle) &&
+        (pLeader->StartBrightness == pDimmer->StartBrightness) && (pLeader->EndBrightness == pDimmer->EndBrightness) &&
+        (pLeader->DeltaCycle == pDimmer->DeltaCycle) && (pLeader->FadeProfile == pDimmer->FadeProfile) &&
+        (pLeader->FadeStep == pDimmer->FadeStep) && (pLeader->FadeStepRem == pDimmer->FadeStepRem)) {
+      pDimmer->Leader = i;
+      debug_tiny_printf("Fade %u follows %u\n", Select, i);
+      return;
     }
   }
+}
+
+// Fade cycle of a follower, the leader is done with this cycle
+static void Dimmer_FadeFollow(Dimmer_Select_t Select) {
+  volatile Dimmer_t *pLeader = &Dimmer[Dimmer[Select].Leader];
+
+  Dimmer[Select].Mode = pLeader->Mode;
+  Dimmer[Select].CurrentBrightness = pLeader->CurrentBrightness;
+  Dimmer[Select].FadePosition = pLeader->FadePosition;
+  Dimmer[Select].RemainingCycle = pLeader->RemainingCycle;
+  Dimmer[Select].CurrentCycle = pLeader->CurrentCycle;
+  Dimmer_FadeInterpolate(Select);
+}
+
+// Before the fade of Select changes, its followers and Select itself continue on their own
+// The followers get the complete fade state of the leader, so they continue exactly where they are
+static void Dimmer_FadeDetach(Dimmer_Select_t Select) {
+  for (uint8_t i = Select + 1; i < DimmerMAX; i++) {
+    if (Dimmer[i].Leader == Select) {
+      memcpy((void *)&Dimmer[i], (const void *)&Dimmer[Select], DIMMER_FADE_STATE);
+      Dimmer[i].Leader = i;
+      Dimmer_FadeInterpolate((Dimmer_Select_t)i); // The leader can be done with this cycle before the follower
+    }
+  }
+  Dimmer[Select].Leader = Select;
+}
+
+// Moves FadePosition Elapsed cycles further (DDA, additions only, the divisions are done once in Dimmer_SetFade)
+// FadeProgress = floor((CyclesDone*FadeRange)/DeltaCycle), FadeRange is DeltaBrightness*256 when linear, else 65535
+//  a rate fade (Dimmer_SetFadeRate) is linear with FadeRange Steps*256 and DeltaCycle Cycles
+// FadePosition = FadeProgress when linear, else the easing curve of FadeProgress (Dimmer_FadeEase)
+static void Dimmer_FadeAdvance(Dimmer_Select_t Select, uint32_t Elapsed) {
+  int16_t CurrentBrightness;
+
+  while ((Elapsed != 0) && (Dimmer[Select].RemainingCycle != 0)) {
+    Elapsed--;
+    Dimmer[Select].RemainingCycle--;
+    Dimmer[Select].FadeProgress += Dimmer[Select].FadeStep;
+    Dimmer[Select].FadeError += Dimmer[Select].FadeStepRem;
+    if (Dimmer[Select].FadeError >= Dimmer[Select].DeltaCycle) {
+      Dimmer[Select].FadeError -= Dimmer[Select].DeltaCycle;
+      Dimmer[Select].FadeProgress++;
+    }
+  }
+  if (Dimmer[Select].RemainingCycle == 0) {
+    Dimmer[Select].FadePosition = (uint16_t)Dimmer[Select].DeltaBrightness << 8; // The curve ends just below 65535, a rate fade can pass it
+  } else if (Dimmer[Select].FadeProfile == DimmerProfileLinear) {
+    Dimmer[Select].FadePosition = Dimmer[Select].FadeProgress;
+  } else {
+    Dimmer[Select].FadePosition = Dimmer_FadeEase(Select);
+  }
 
-  DurationDone = CurrentCount - Dimmer[Select].StartCycle;
-  Value32 = (uint32_t)DurationDone * Dimmer[Select].DeltaBrightness;
-    
   if (Dimmer[Select].Mode == DimmerModeFadeUp) {
-    CurrentBrightness = Dimmer[Select].StartBrightness + (uint8_t)(Value32/Dimmer[Select].DeltaCycle);
+    CurrentBrightness = Dimmer[Select].StartBrightness + (uint8_t)(Dimmer[Select].FadePosition>>8);
   } else {
-    CurrentBrightness = Dimmer[Select].StartBrightness - (uint8_t)(Value32/Dimmer[Select].DeltaCycle);
+    CurrentBrightness = Dimmer[Select].StartBrightness - (uint8_t)(Dimmer[Select].FadePosition>>8);
   }
   
   if (CurrentBrightness < 0) {
@@ -335,45 +772,100 @@ void Dimmer_CalcFade(Dimmer_Select_t Select, uint32_t CurrentCount) {
     CurrentBrightness = LUT_DALI_Size;
   }
   Dimmer[Select].CurrentBrightness = CurrentBrightness;
+}
+
+// FadePosition of the easing curve at FadeProgress, the curve is linear in between its points
+// 2 flash reads and 2 multiplications, the same cost every cycle
+static uint16_t Dimmer_FadeEase(Dimmer_Select_t Select) {
+  const uint16_t *pCurve = LUT_FADE[Dimmer[Select].FadeProfile - 1];
+  uint16_t Progress = Dimmer[Select].FadeProgress;
+  uint8_t Index = Progress >> LUT_FADE_Segment_Bits;
+  uint16_t Low = pgm_read_word_near(pCurve + Index);
+  uint16_t High = pgm_read_word_near(pCurve + Index + 1);
+  uint16_t Eased;
+
+  Eased = Low + (uint16_t)(((uint32_t)(High - Low) * (Progress & ((1 << LUT_FADE_Segment_Bits) - 1))) >> LUT_FADE_Segment_Bits);
+  return (uint16_t)(((uint32_t)Eased * ((uint16_t)Dimmer[Select].DeltaBrightness << 8)) >> 16);
+}
+
+// OCR value of CurrentBrightness, interpolated towards the next Dali value with the FadePosition fraction
+static void Dimmer_FadeInterpolate(Dimmer_Select_t Select) {
+  uint8_t CurrentBrightness;
+  uint8_t DeltaCurrentBrightness;
+  uint16_t OCR_Value;
+  uint16_t DeltaDali;
+  uint16_t Value16;
+
+  CurrentBrightness = Dimmer[Select].CurrentBrightness;
+  DeltaCurrentBrightness = (uint8_t)Dimmer[Select].FadePosition;
 
   if (CurrentBrightness == 0) {
     OCR_Value = 0; // turn off
-    DeltaDali = 0;
   } else {
-    OCR_Value = DaliTable[CurrentBrightness-1];
+    OCR_Value = Dimmer_DaliOCR(Select, CurrentBrightness);
     if (Dimmer[Select].Mode == DimmerModeFadeUp) {
-      if (CurrentBrightness == LUT_DALI_Size) {
-        DeltaDali = 0;
-      } else {
-        DeltaDali = DaliTable[CurrentBrightness-1]-DaliTable[CurrentBrightness];
-        DeltaCurrentBrightness = (uint8_t)((Value32*256) / Dimmer[0].DeltaCycle);
-        Value16 = (uint16_t)((((uint32_t)DeltaDali*DeltaCurrentBrightness)+128)/256);
+      if (CurrentBrightness != LUT_DALI_Size) {
+        DeltaDali = OCR_Value - Dimmer_DaliOCR(Select, CurrentBrightness+1);
+        Value16 = Dimmer_FadeTicks(Select, DeltaDali, DeltaCurrentBrightness);
         OCR_Value -= Value16;
       }
     } else {
-      if (CurrentBrightness == 1) {
-        DeltaDali = 0;
-      } else {
-        DeltaDali = DaliTable[CurrentBrightness-2]-DaliTable[CurrentBrightness-1];
-        DeltaCurrentBrightness = (uint8_t)((Value32*256) / Dimmer[Select].DeltaCycle);
-        Value16 = (uint16_t)((((uint32_t)DeltaDali*DeltaCurrentBrightness)+128)/256); 
+      if (CurrentBrightness != 1) {
+        DeltaDali = Dimmer_DaliOCR(Select, CurrentBrightness-1) - OCR_Value;
+        Value16 = Dimmer_FadeTicks(Select, DeltaDali, DeltaCurrentBrightness);
         OCR_Value += Value16;
       }
     }
   }  
   Dimmer[Select].CurrentOCR = OCR_Value;
-  // Check if done with fade
-  if (CurrentCount == Dimmer[Select].EndCycle) {
-    Dimmer[Select].Mode = DimmerModeFadePostAction;
-    debug_tiny_printf("Done with Fade\n");
+}
+
+// Ticks of Fraction/256 of DeltaDali, rounded
+// With DIMMER_DITHERING the dropped fraction of a tick is carried to the next half periods (first order sigma-delta),
+// the firing time alternates between 2 ticks and has a resolution of 1/256 tick on average
+// An 8 bit addition and its carry per channel and cycle
+static inline uint16_t Dimmer_FadeTicks(Dimmer_Select_t Select, uint16_t DeltaDali, uint8_t Fraction) {
+  uint32_t Product = (uint32_t)DeltaDali * Fraction;
+#if defined(DIMMER_DITHERING)
+  uint16_t Ticks = (uint16_t)(Product >> 8);
+  uint8_t Error = Dimmer[Select].DitherError + (uint8_t)Product;
+
+  if (Error < (uint8_t)Product) {
+    Ticks++; // Carry, a whole tick of fractions
   }
-  PORTB &= ~(1<<PORTB3);  // Clear D11
+  Dimmer[Select].DitherError = Error;
+  return Ticks;
+#else
+  (void)Select;
+  return (uint16_t)((Product + 128) / 256);
+#endif
 }
 
 void Dimmer_SetFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness) {
-  Dimmer[Select].StartCycle = Dimmer_CurrentCycle;
-  Dimmer[Select].DeltaCycle = ((ExternalDimmer_MAINS_HZ*2)*(uint32_t)DurationMS)/1000;
+  Dimmer_SetFadeProfile(Select, DurationMS, EndBrightness, DimmerProfileLinear);
+}
+
+// Stops a running sequence, an unknown Profile fades linear
+void Dimmer_SetFadeProfile(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness, Dimmer_Profile_t Profile) {
+  Dimmer_Sequence[Select].Count = 0;
+  Dimmer_StartFade(Select, DurationMS, EndBrightness, Profile);
+  Dimmer_FadeLeader(Select);
+}
+
+static void Dimmer_StartFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness, Dimmer_Profile_t Profile) {
+  uint16_t FadeRange;
+
+  Dimmer_FadeDetach(Select);
+
+  Dimmer[Select].StartCycle = Dimmer_AheadCycle; // The cycle the fade values are calculated up to
+  // Half cycles of the tracked mains, a half period is Dimmer_HalfPeriod/2000 mS
+  Dimmer[Select].DeltaCycle = (DurationMS * 2000 + Dimmer_HalfPeriod / 2) / Dimmer_HalfPeriod;
+  if (Dimmer[Select].DeltaCycle == 0) {
+    Dimmer[Select].DeltaCycle = 1; // Fade faster than a half cycle, done on the next cycle
+  }
   Dimmer[Select].EndCycle = Dimmer[Select].StartCycle + Dimmer[Select].DeltaCycle;
+  Dimmer[Select].CurrentCycle = Dimmer[Select].StartCycle;
+  Dimmer[Select].RemainingCycle = Dimmer[Select].DeltaCycle;
 
 #if defined(DIMMER_DEBUG_INFO)
   //tiny_printf("Dur %i StartC %i DeltaC %i EndC %i .\n", DurationMS, Dimmer[Select].StartCycle, Dimmer[Select].DeltaCycle, Dimmer[Select].EndCycle);
@@ -396,7 +888,20 @@ void Dimmer_SetFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrig
     DimmerOCR[Select].Enable = 1;
   } else {
     // Do nothing
+    Dimmer[Select].DeltaBrightness = 0;
+  }
+
+  // Setup of the DDA used by Dimmer_FadeAdvance, the only divisions of a fade
+  if (Profile >= DimmerProfileMAX) {
+    Profile = DimmerProfileLinear;
   }
+  Dimmer[Select].FadeProfile = Profile;
+  FadeRange = (Profile == DimmerProfileLinear) ? ((uint16_t)Dimmer[Select].DeltaBrightness*256) : 65535;
+  Dimmer[Select].FadePosition = 0;
+  Dimmer[Select].FadeProgress = 0;
+  Dimmer[Select].FadeError = 0;
+  Dimmer[Select].FadeStep = FadeRange / Dimmer[Select].DeltaCycle;
+  Dimmer[Select].FadeStepRem = FadeRange % Dimmer[Select].DeltaCycle;
   
 #if defined(DIMMER_DEBUG_INFO)
   //tiny_printf("StartB %u EndB %u DeltaB %u Mode %u .\n", Dimmer[Select].StartBrightness, Dimmer[Select].EndBrightness, Dimmer[Select].DeltaBrightness, Dimmer[Select].Mode);
@@ -408,8 +913,84 @@ void Dimmer_SetFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrig
 #endif
 }
 
+// Fades through Count keyframes (at most DIMMER_SEQUENCE_SIZE) from the current brightness, starts at once
+// Stopped by all other Set and Fade functions, Count 0 only stops a running sequence
+void Dimmer_SetSequence(Dimmer_Select_t Select, const Dimmer_Keyframe_t *pKeyframe, uint8_t Count, uint8_t Loop, Dimmer_Profile_t Profile) {
+  Dimmer_Sequence_t *pSequence = &Dimmer_Sequence[Select];
+
+  if (Count > DIMMER_SEQUENCE_SIZE) {
+    Count = DIMMER_SEQUENCE_SIZE;
+  }
+  for (uint8_t i = 0; i < Count; i++) {
+    pSequence->Keyframe[i] = pKeyframe[i];
+    if (pSequence->Keyframe[i].Brightness > LUT_DALI_Size) {
+      pSequence->Keyframe[i].Brightness = LUT_DALI_Size;
+    }
+  }
+  pSequence->Count = Count;
+  pSequence->Index = 0xFF; // Dimmer_SequenceNext starts with the first keyframe
+  pSequence->Loop = Loop;
+  pSequence->Profile = Profile;
+  debug_tiny_printf("Sequence %u loop %u\n", Count, Loop);
+  if (Count != 0) {
+    Dimmer_SequenceNext(Select);
+  }
+}
+
+// Keyframe being faded to 1..DIMMER_SEQUENCE_SIZE, 0 when no sequence is running
+uint8_t Dimmer_GetSequence(Dimmer_Select_t Select) {
+  return (Dimmer_Sequence[Select].Count != 0) ? (Dimmer_Sequence[Select].Index + 1) : 0;
+}
+
+// Starts the fade to the next keyframe, or ends the sequence after the last one
+static void Dimmer_SequenceNext(Dimmer_Select_t Select) {
+  Dimmer_Sequence_t *pSequence = &Dimmer_Sequence[Select];
+  Dimmer_Keyframe_t *pKeyframe;
+
+  pSequence->Index++; // 0xFF wraps to the first keyframe
+  if (pSequence->Index >= pSequence->Count) {
+    if (!pSequence->Loop) {
+      pSequence->Count = 0; // Done, the brightness of the last keyframe stays
+      return;
+    }
+    pSequence->Index = 0;
+  }
+  pKeyframe = &pSequence->Keyframe[pSequence->Index];
+  Dimmer_StartFade(Select, pKeyframe->DurationMS, pKeyframe->Brightness, (Dimmer_Profile_t)pSequence->Profile);
+  if (Dimmer[Select].DeltaBrightness == 0) {
+    Dimmer[Select].Mode = DimmerModeFadeUp; // Hold, a fade of 0 steps that ends after DurationMS
+  }
+  Dimmer_FadeLeader(Select);
+}
+
+// Fades Steps Dali steps every Cycles half cycles to EndBrightness, the fade time follows from the rate
+// The DDA of a linear Dimmer_SetFade, with the increment of the rate instead of the duration, so the same cost per cycle
+void Dimmer_SetFadeRate(Dimmer_Select_t Select, uint8_t EndBrightness, uint8_t Steps, uint8_t Cycles) {
+  uint16_t FadeRange;
+
+  if (Steps == 0) {
+    Steps = 1;
+  }
+  if (Cycles == 0) {
+    Cycles = 1;
+  }
+  Dimmer_Sequence[Select].Count = 0;
+  Dimmer_StartFade(Select, 0, EndBrightness, DimmerProfileLinear);
+  FadeRange = (uint16_t)Steps * 256;
+  Dimmer[Select].DeltaCycle = Cycles; // DDA divisor, FadeRange every DeltaCycle cycles
+  Dimmer[Select].FadeStep = FadeRange / Cycles;
+  Dimmer[Select].FadeStepRem = FadeRange % Cycles;
+  // The last cycle ends exactly on EndBrightness, at most Steps Dali steps
+  Dimmer[Select].RemainingCycle = ((uint16_t)Dimmer[Select].DeltaBrightness * Cycles + Steps - 1) / Steps;
+  Dimmer[Select].EndCycle = Dimmer[Select].StartCycle + Dimmer[Select].RemainingCycle;
+  Dimmer_FadeLeader(Select);
+  debug_tiny_printf("Fade rate %u/%u cycles %u\n", Steps, Cycles, Dimmer[Select].RemainingCycle);
+}
+
 void Dimmer_SetBrightness(Dimmer_Select_t Select, uint8_t Brightness) {
   uint16_t OCR_Value;
+  Dimmer_Sequence[Select].Count = 0;
+  Dimmer_FadeDetach(Select);
   Dimmer[Select].DeltaBrightness = 0;
   if (Brightness == 0) {
     Dimmer[Select].Mode = DimmerModeOff;
@@ -427,7 +1008,7 @@ void Dimmer_SetBrightness(Dimmer_Select_t Select, uint8_t Brightness) {
     DimmerOCR[Select].Enable = 1;
     Dimmer[Select].CurrentBrightness = Brightness;
     Dimmer[Select].EndBrightness = Brightness;
-    OCR_Value = DaliTable[Brightness-1];
+    OCR_Value = Dimmer_DaliOCR(Select, Brightness);
     Dimmer[Select].CurrentOCR = OCR_Value;
   }
   debug_tiny_printf("CurB %i\n", Dimmer[Select].CurrentBrightness);
@@ -441,6 +1022,8 @@ uint8_t Dimmer_GetBrightness(Dimmer_Select_t Select) {
 }
 
 void Dimmer_SetDirectValue(Dimmer_Select_t Select, uint16_t Value) {
+  Dimmer_Sequence[Select].Count = 0;
+  Dimmer_FadeDetach(Select);
   Dimmer[Select].Mode = DimmerModeOn;
   Dimmer[Select].CurrentBrightness = 0;
   Dimmer[Select].EndBrightness = 0;
@@ -457,9 +1040,211 @@ void Dimmer_SetDirectValue(Dimmer_Select_t Select, uint16_t Value) {
   debug_tiny_printf("Mode %i\n", Dimmer[Select].Mode);
 }
 
+uint32_t Dimmer_GetCycle(void) {
+  return Dimmer_CurrentCycle;
+}
+
+// Timer1 ticks of the last half period (zero crossing to zero crossing)
+uint16_t Dimmer_GetPulsePeriod(void) {
+  return Dimmer_CurrentPulsePeriod;
+}
+
 uint16_t Dimmer_GetDirectValue(Dimmer_Select_t Select) {
   uint16_t Value;
   Value = Dimmer[Select].CurrentOCR;
   debug_tiny_printf("Get direct %i\n", Value);
   return Value;
-}
\ No newline at end of file
+}
+#if defined(DEBUG_DIMMER_BENCHMARK)
+// Fade position as calculated before the DDA, 2 divisions every cycle
+static uint16_t Dimmer_BenchmarkReference(uint8_t DeltaBrightness, uint32_t DeltaCycle, uint32_t DurationDone) {
+  uint32_t Value32;
+  uint8_t Brightness;
+  uint8_t DeltaCurrentBrightness;
+
+  Value32 = (uint32_t)DurationDone * DeltaBrightness;
+  Brightness = (uint8_t)(Value32/DeltaCycle);
+  DeltaCurrentBrightness = (uint8_t)((Value32*256) / DeltaCycle);
+  return ((uint16_t)Brightness<<8) + DeltaCurrentBrightness;
+}
+
+// Compares the division and DDA fade calculation for all Start, End and Duration combinations
+// Time is in CPU cycles (HAL_BenchCycles, a resolution of one Timer1 tick), in nanoseconds on the host
+void Dimmer_Benchmark(void) {
+  const uint16_t Durations[] = { 100, 1000, 10000, 65535 };
+  uint32_t TicksReference = 0;
+  uint32_t TicksDDA = 0;
+  HAL_Bench_t MaxReference = 0;
+  HAL_Bench_t MaxDDA = 0;
+  uint32_t Steps = 0;
+  uint32_t Mismatch = 0;
+  uint16_t Reference;
+  HAL_Bench_t T0, T1, T2;
+
+  tiny_printf("Dimmer: Begin benchmark, %s\n", HAL_BENCH_UNIT);
+  USARTP_FlushTX_Buffer();
+  for (uint8_t d = 0; d < sizeof(Durations)/sizeof(Durations[0]); d++) {
+    for (uint16_t Start = 0; Start <= LUT_DALI_Size; Start += DIMMER_BENCHMARK_STRIDE) {
+      for (uint16_t End = 0; End <= LUT_DALI_Size; End += DIMMER_BENCHMARK_STRIDE) {
+        if (Start == End) {
+          continue;
+        }
+        Dimmer[Dimmer0].CurrentBrightness = Start;
+        Dimmer_SetFade(Dimmer0, Durations[d], End);
+        for (uint32_t Done = 1; Done <= Dimmer[Dimmer0].DeltaCycle; Done++) {
+          T0 = HAL_BenchTicks();
+          Reference = Dimmer_BenchmarkReference(Dimmer[Dimmer0].DeltaBrightness, Dimmer[Dimmer0].DeltaCycle, Done);
+          T1 = HAL_BenchTicks();
+          Dimmer_FadeAdvance(Dimmer0, 1);
+          T2 = HAL_BenchTicks();
+          TicksReference += (HAL_Bench_t)(T1-T0);
+          TicksDDA += (HAL_Bench_t)(T2-T1);
+          if ((HAL_Bench_t)(T1-T0) > MaxReference) {
+            MaxReference = T1-T0;
+          }
+          if ((HAL_Bench_t)(T2-T1) > MaxDDA) {
+            MaxDDA = T2-T1;
+          }
+          if (Reference != Dimmer[Dimmer0].FadePosition) {
+            Mismatch++;
+          }
+          Steps++;
+        }
+      }
+    }
+  }
+  tiny_printf("Steps %u Mismatch %u\n", Steps, Mismatch);
+  tiny_printf("Division per step %u max %u\n", HAL_BenchCycles(TicksReference/Steps), HAL_BenchCycles(MaxReference));
+  tiny_printf("DDA per step %u max %u\n", HAL_BenchCycles(TicksDDA/Steps), HAL_BenchCycles(MaxDDA));
+  USARTP_FlushTX_Buffer();
+
+  // Work of a channel per cycle of a fade (Dimmer_FadeAdvance and Dimmer_FadeInterpolate) for every profile
+  // An error is a step back in brightness or a fade that does not end at its end brightness
+  uint16_t Previous;
+  for (uint8_t Profile = 0; Profile < DimmerProfileMAX; Profile++) {
+    TicksDDA = 0;
+    MaxDDA = 0;
+    Steps = 0;
+    Mismatch = 0;
+    for (uint8_t d = 0; d < sizeof(Durations)/sizeof(Durations[0]); d++) {
+      for (uint16_t Start = 0; Start <= LUT_DALI_Size; Start += DIMMER_BENCHMARK_STRIDE) {
+        for (uint16_t End = 0; End <= LUT_DALI_Size; End += DIMMER_BENCHMARK_STRIDE) {
+          if (Start == End) {
+            continue;
+          }
+          Dimmer[Dimmer0].CurrentBrightness = Start;
+          Dimmer_SetFadeProfile(Dimmer0, Durations[d], End, (Dimmer_Profile_t)Profile);
+          Previous = 0;
+          for (uint32_t Done = 1; Done <= Dimmer[Dimmer0].DeltaCycle; Done++) {
+            T0 = HAL_BenchTicks();
+            Dimmer_FadeAdvance(Dimmer0, 1);
+            Dimmer_FadeInterpolate(Dimmer0);
+            T1 = HAL_BenchTicks();
+            TicksDDA += (HAL_Bench_t)(T1-T0);
+            if ((HAL_Bench_t)(T1-T0) > MaxDDA) {
+              MaxDDA = T1-T0;
+            }
+            if (Dimmer[Dimmer0].FadePosition < Previous) {
+              Mismatch++;
+            }
+            Previous = Dimmer[Dimmer0].FadePosition;
+            Steps++;
+          }
+          if (Dimmer[Dimmer0].CurrentBrightness != End) {
+            Mismatch++;
+          }
+        }
+      }
+    }
+    tiny_printf("Profile %u steps %u errors %u per step %u max %u\n", Profile, Steps, Mismatch, HAL_BenchCycles(TicksDDA/Steps), HAL_BenchCycles(MaxDDA));
+    USARTP_FlushTX_Buffer();
+  }
+
+  // OCR value of a Dali value, RAM table of the calibration (as before the per channel calibration) against the calculation
+  uint16_t Table[LUT_DALI_Size];
+  uint32_t DaliValue = 0;
+  volatile uint16_t Value;
+  for (uint8_t i = 0; i < LUT_DALI_Size; i++) {
+    DaliValue += pgm_read_word_near(LUT_DALI+i);
+    Table[i] = ExternalDimmer_RangeMax(Dimmer0) - (uint16_t)(((uint32_t)(ExternalDimmer_RangeMax(Dimmer0) - ExternalDimmer_RangeMin(Dimmer0)) * DaliValue + LUT_DALI_Resolution) / LUT_DALI_Resolution);
+  }
+  TicksReference = 0;
+  TicksDDA = 0;
+  MaxReference = 0;
+  MaxDDA = 0;
+  Mismatch = 0;
+  for (uint16_t Brightness = 1; Brightness <= LUT_DALI_Size; Brightness++) {
+    T0 = HAL_BenchTicks();
+    Value = Table[Brightness-1];
+    T1 = HAL_BenchTicks();
+    Reference = Value;
+    Value = Dimmer_DaliOCR(Dimmer0, Brightness);
+    T2 = HAL_BenchTicks();
+    TicksReference += (HAL_Bench_t)(T1-T0);
+    TicksDDA += (HAL_Bench_t)(T2-T1);
+    if ((HAL_Bench_t)(T1-T0) > MaxReference) {
+      MaxReference = T1-T0;
+    }
+    if ((HAL_Bench_t)(T2-T1) > MaxDDA) {
+      MaxDDA = T2-T1;
+    }
+    if (Reference != Value) {
+      Mismatch++;
+    }
+  }
+  // A fade step of a channel calculates 2 values
+  tiny_printf("Dali values %u Mismatch %u\n", LUT_DALI_Size, Mismatch);
+  tiny_printf("Dali table per value %u max %u\n", HAL_BenchCycles(TicksReference/LUT_DALI_Size), HAL_BenchCycles(MaxReference));
+  tiny_printf("Dali calculation per value %u max %u\n", HAL_BenchCycles(TicksDDA/LUT_DALI_Size), HAL_BenchCycles(MaxDDA));
+
+#if defined(DIMMER_SORTED_SCHEDULER)
+  // Firing list build time and worst merge error (an event moved to a neighbour) per number of active channels
+  // The firing error at the gate adds the compare Irq latency, measured with the host simulator (README.md)
+  uint32_t Random = 1;
+  uint16_t Error;
+  uint16_t MaxError;
+  uint16_t MaxEvents;
+  for (uint8_t Channels = 1; Channels <= DimmerMAX; Channels++) {
+    TicksDDA = 0;
+    MaxDDA = 0;
+    MaxError = 0;
+    MaxEvents = 0;
+    for (uint16_t Round = 0; Round < 1000; Round++) {
+      for (uint8_t i = 0; i < DimmerMAX; i++) {
+        Random = Random * 1103515245 + 12345;
+        Dimmer[i].CurrentOCR = ExternalDimmer_RangeMin(i) + (uint16_t)(Random >> 16) % (ExternalDimmer_RangeMax(i) - ExternalDimmer_RangeMin(i));
+        DimmerOCR[i].Enable = (i < Channels);
+      }
+      T0 = HAL_BenchTicks();
+      Error = Dimmer_BuildEventList(Dimmer_AheadHead);
+      T1 = HAL_BenchTicks();
+      TicksDDA += (HAL_Bench_t)(T1-T0);
+      if ((HAL_Bench_t)(T1-T0) > MaxDDA) {
+        MaxDDA = T1-T0;
+      }
+      if (Error > MaxError) {
+        MaxError = Error;
+      }
+      if (DimmerEventList[Dimmer_AheadHead].Count > MaxEvents) {
+        MaxEvents = DimmerEventList[Dimmer_AheadHead].Count;
+      }
+    }
+    tiny_printf("Channels %u events %u merge %u ticks build %u max %u\n", Channels, MaxEvents, MaxError, HAL_BenchCycles(TicksDDA/1000), HAL_BenchCycles(MaxDDA));
+    USARTP_FlushTX_Buffer();
+  }
+  for (uint8_t i = 0; i < DimmerMAX; i++) {
+    Dimmer[i].CurrentOCR = 0;
+    DimmerOCR[i].Enable = 0;
+  }
+  DimmerEventList[Dimmer_AheadHead].Count = 0;
+#endif
+
+  tiny_printf("Dimmer: End benchmark\n");
+  USARTP_FlushTX_Buffer();
+
+  Dimmer[Dimmer0].Mode = DimmerModeOff;
+  Dimmer[Dimmer0].CurrentBrightness = 0;
+  Dimmer[Dimmer0].CurrentOCR = 0;
+  DimmerOCR[Dimmer0].Enable = 0;
+}
+#endif
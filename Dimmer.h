@@ -11,6 +11,7 @@ extern "C" {
 
 #include <stdint.h>
 #include "DaliLut.h"
+#include "Dimmer_Config.h"
 
 extern volatile uint8_t DimmerDemo;
 
@@ -19,18 +20,45 @@ extern volatile uint8_t DimmerDemo;
 typedef enum {
   Dimmer0 = 0,
   Dimmer1 = 1,
-  DimmerMAX = 2,
+  Dimmer2 = 2,
+  Dimmer3 = 3,
+  Dimmer4 = 4,
+  Dimmer5 = 5,
+  Dimmer6 = 6,
+  Dimmer7 = 7,
+  DimmerMAX = DIMMER_CHANNELS,
 } Dimmer_Select_t;
 
+// Brightness over the time of a fade, in Dali steps
+typedef enum {
+  DimmerProfileLinear = 0,
+  DimmerProfileEaseIn = 1,  // Slow start
+  DimmerProfileEaseOut = 2, // Slow end
+  DimmerProfileSCurve = 3,  // Slow start and end
+  DimmerProfileMAX,
+} Dimmer_Profile_t;
+
+// Segment of a fade sequence, fade to Brightness in DurationMS
+//  A keyframe with the brightness of the previous one holds that brightness for DurationMS
+typedef struct {
+  uint8_t  Brightness;
+  uint16_t DurationMS;
+} Dimmer_Keyframe_t;
+
 
 void Dimmer_Initialize(void);
 void Dimmer_Scheduler(void);
-void Dimmer_UpdateDaliTable(uint16_t TriacPulseMin, uint16_t TriacPulseMax);
 void Dimmer_SetFade(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness);
+void Dimmer_SetFadeProfile(Dimmer_Select_t Select, uint32_t DurationMS, uint8_t EndBrightness, Dimmer_Profile_t Profile);
+void Dimmer_SetFadeRate(Dimmer_Select_t Select, uint8_t EndBrightness, uint8_t Steps, uint8_t Cycles);
+void Dimmer_SetSequence(Dimmer_Select_t Select, const Dimmer_Keyframe_t *pKeyframe, uint8_t Count, uint8_t Loop, Dimmer_Profile_t Profile);
+uint8_t Dimmer_GetSequence(Dimmer_Select_t Select);
 void Dimmer_SetBrightness(Dimmer_Select_t Select, uint8_t Brightness);
 uint8_t Dimmer_GetBrightness(Dimmer_Select_t Select);
 void Dimmer_SetDirectValue(Dimmer_Select_t Select, uint16_t Value);
 uint16_t Dimmer_GetDirectValue(Dimmer_Select_t Select);
+uint32_t Dimmer_GetCycle(void);
+uint16_t Dimmer_GetPulsePeriod(void);
 
 #ifdef __cplusplus
 }
@@ -1,7 +1,7 @@
 // TODO check if UART Irqs are active or not!
 // TODO check if other IRQs except for OCRA, B, ICP are active
 
-// TODO Check the time needed for a fade recalc
+// Scheduler run times and missed zero crossings, see Monitor.h and DIMMER_CMD_GET_MONITOR
 // TODO add check "The data overrun (DORn) flag indicates", if then send NAK and reset STX flag
 // TODO see datasheet for USART examples, if calculations takes more than 500 uS do lower the baudratae to for example 2400 baud. Question, how slow does communication need to be ?
 
@@ -9,7 +9,7 @@
 // TODO enums to be DIMMER_ and the rest normal
 // Variables to be DimmerVar
 
-#include "Arduino.h"
+#include "HAL.h"
 #include <stdio.h>
 #include "Dimmer.h"
 #include "Dimmer_Config.h"
@@ -18,6 +18,8 @@
 #include "TinyPrintf.h"
 #include "Command.h"
 #include "Settings.h"
+#include "Monitor.h"
+#include "Mains.h"
 
 void setup() {
   TIMSK0 = 0; // Disable Timer0 (not needed), causes erratic behavior for other Irqs
@@ -25,15 +27,23 @@ void setup() {
   LED_Set; 
   USARTP_Initialize(9600);
   SET_Initialize();
+  Mains_Initialize();
   Dimmer_Initialize();
-  Dimmer_UpdateDaliTable(Settings.RangeMin, Settings.RangeMax);
   Command_Initialize();
+  Monitor_Initialize();
   LED_Clear;
 }
 
 
 void loop() {
+  HAL_Bench_t Ticks;
+
+  Ticks = HAL_BenchTicks();
   Dimmer_Scheduler();
+  Ticks = Monitor_Measure(MonitorDimmer, Ticks);
   USARTP_Scheduler();
+  Ticks = Monitor_Measure(MonitorUSARTP, Ticks);
   Command_Scheduler();
+  SET_Scheduler(); // EEPROM write-behind of Save, measured with the Command scheduler
+  Monitor_Measure(MonitorCommand, Ticks);
 }
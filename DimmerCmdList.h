@@ -9,64 +9,126 @@
 extern "C" {
 #endif
 
-#define DIMMER_CMD_VERSION  1
+#define DIMMER_CMD_VERSION  2 // 2: SetFadeSteps 0x12 has Steps and Cycles (was one Steps byte)
 
 // Protocol:
 // Send => <STX><data bytes><ETX>
 // Return => <ACK>[<STX><data bytes><ETX>]
+//  STX = '#', ETX = '\n', data bytes in hex characters (upper or lowercase), Address Command Param1 ..
+//  A non hex character is answered with NAK at once, the rest of the command is ignored
+// Binary protocol, selected per command by its first byte, the reply uses the same protocol:
+// Send => <0xA0|N><Address><Command><N data bytes><CRC8>
+// Return => <ACK>[<0xA0|N><N data bytes><CRC8>]
+//  N = 0..14 (limited by the receive buffer, CMD_MAX_DATA), multi byte values big endian
+//  CRC8 polynomial 0x07, initial value 0x00, over all bytes before it
+//  A gap of more than CMD_BIN_TIMEOUT half periods (Command_CFG.h) in a frame drops it, the next byte starts a new command
 
-// DIMMER_CMD_ Address _SIZE (bytes) Command Param1 Size min max Scratch Param2 Size min max Scratch
-#define DIMMER_CMD_OFF_ADDR                   0x00 // 0	Off
-#define DIMMER_CMD_OFF_SIZE                   0
-#define DIMMER_CMD_ON_MAX_ADDR                0x02 // 0 OnMax (254)
-#define DIMMER_CMD_ON_MAX_SIZE                0
-#define DIMMER_CMD_STOP_ADDR                  0x03 // 0 Stop (255) - -
-#define DIMMER_CMD_STOP_SIZE                  0
+// Addresses
+//  0x00..0x07 Dimmer (channel) 0..7
+//  Broadcast, all dimmers: <0x10><Command><Data>
+//  Group, dimmers of the mask (bit 0 is dimmer 0): <0x11><Mask><Command><Data>
+//  Batch of write commands: <0x12><Address><Command><Data><Address><Command><Data>..
+//   Address of a batch tuple is a dimmer, broadcast or group address
+//   All tuples are checked first, then executed together before the next zero crossing
+//  Broadcast, group and batch write commands reply with one ACK (all ok) or NAK, read commands are not answered
+#define DIMMER_ADDR_BROADCAST                 0x10
+#define DIMMER_ADDR_GROUP                     0x11
+#define DIMMER_ADDR_BATCH                     0x12
+//  Queue a command for a Dimmer cycle (half period count, see GetCycle): <0x13><Cycle uint32_t><Address><Command><Data>
+//   Executed on that zero crossing, commands must be queued in cycle order, ACK when queued, NAK when the queue is full
+//   Exact when queued more than DIMMER_LOOKAHEAD (Dimmer_Config.h) cycles ahead of GetCycle, else on the first cycle not calculated yet
+#define DIMMER_ADDR_QUEUE                     0x13
 
-#define DIMMER_CMD_SET_ADDR                   0x10 // 1 Set DaliValue uin8_t 0 255 -
-#define DIMMER_CMD_SET_SIZE                   2
-#define DIMMER_CMD_GET_SET_ADDR               0x90 // 1 Return Set value DaliValue uin8_t
-#define DIMMER_CMD_GET_SET_SIZE               0
-#define DIMMER_CMD_SET_FADE_TIME_ADDR         0x11 // 3 SetFadeTime DaliValue uint8_t 0 254 0 Time_ms uint16_t 100 65535 100
-#define DIMMER_CMD_SET_FADE_TIME_SIZE         6
-#define DIMMER_CMD_SET_FADE_STEPS_ADDR        0x12 // 2 SetFadeSteps DaliValue uint8_t 0 254 0 1/steps per fade uint8_t 1 255 1
-#define DIMMER_CMD_SET_FADE_STEPS_SIZE        4
+// Command list, one line for every command: X(Name, Address, Size, Param, Min, Max, Reply, Handler)
+//  Name     Generates DIMMER_CMD_<Name>_ADDR and DIMMER_CMD_<Name>_SIZE (data size in hex characters)
+//  Address  Command, 0x80 and higher are read commands
+//  Size     Data bytes
+//  Param    Check of the first parameter before the Handler is called
+//            DIMMER_PARAM_NONE   Not checked
+//            DIMMER_PARAM_MAGIC  uint8_t, the command is ignored when it is not within Min..Max
+//            DIMMER_PARAM_TIMER  uint16_t, set to the range minimum when outside the timer range of the mains frequency
+//  Reply    Reply bytes of a read command (1, 2 or 4), 0 for a write command
+//  Handler  Function in Command.cpp
+#define DIMMER_PARAM_NONE   0
+#define DIMMER_PARAM_MAGIC  1
+#define DIMMER_PARAM_TIMER  2
 
-#define DIMMER_CMD_SAVE_ADDR                  0x30 // 1 Save MagicNumber uint8_t - - 0x55 -
-#define DIMMER_CMD_SAVE_SIZE                  2
 #define DIMMER_CMD_SAVE_MAGIC_NUMBER          0x55
-#define DIMMER_CMD_LOAD_ADDR                  0x31 // 1 Load MagicNumber uint8_t - - 0x66 -
-#define DIMMER_CMD_LOAD_SIZE                  2
 #define DIMMER_CMD_LOAD_MAGIC_NUMBER          0x66
-#define DIMMER_CMD_LOAD_SCRATCH_ADDR          0x32 // 1 LoadScratch MagicNumber uint8_t - - 0x77 -
-#define DIMMER_CMD_LOAD_SCRATCH_SIZE          2
 #define DIMMER_CMD_LOAD_SCRATCH_MAGIC_NUMBER  0x77
 
-#define DIMMER_CMD_SET_MAINZ_HZ_VAL_ADDR      0x70
-#define DIMMER_CMD_SET_MAINZ_HZ_VAL_SIZE      2
-#define DIMMER_CMD_GET_MAINZ_HZ_VAL_ADDR      0xF0
-#define DIMMER_CMD_GET_MAINZ_HZ_VAL_SIZE      0
+#define DIMMER_CMD_LIST(X) \
+  /* Off */ \
+  X(OFF,               0x00, 0, DIMMER_PARAM_NONE,  0, 0, 0, Command_Off) \
+  /* OnMax (254) */ \
+  X(ON_MAX,            0x02, 0, DIMMER_PARAM_NONE,  0, 0, 0, Command_OnMax) \
+  /* Stop (255) */ \
+  X(STOP,              0x03, 0, DIMMER_PARAM_NONE,  0, 0, 0, Command_Stop) \
+  /* Remove all queued commands */ \
+  X(CLEAR_QUEUE,       0x04, 0, DIMMER_PARAM_NONE,  0, 0, 0, Command_ClearQueue) \
+  /* Reset the main loop run times, missed cycles, dropped TX bytes and rejected zero crossings of GetMonitor */ \
+  X(RESET_MONITOR,     0x05, 0, DIMMER_PARAM_NONE,  0, 0, 0, Command_ResetMonitor) \
+  /* Set DaliValue uint8_t 0 255 */ \
+  X(SET,               0x10, 1, DIMMER_PARAM_NONE,  0, 0, 0, Command_Set) \
+  /* Return Set value DaliValue uint8_t */ \
+  X(GET_SET,           0x90, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetSet) \
+  /* SetFadeTime DaliValue uint8_t 0 254, Time_ms uint16_t 100 65535 */ \
+  X(SET_FADE_TIME,     0x11, 3, DIMMER_PARAM_NONE,  0, 0, 0, Command_SetFadeTime) \
+  /* SetFadeSteps DaliValue uint8_t 0 254, Steps uint8_t 1 255, Cycles uint8_t 1 255 */ \
+  /*  Fades Steps Dali steps every Cycles half periods, the fade time follows from the distance (0 is taken as 1) */ \
+  X(SET_FADE_STEPS,    0x12, 3, DIMMER_PARAM_NONE,  0, 0, 0, Command_SetFadeSteps) \
+  /* SetFadeProfile DaliValue uint8_t 0 254, Time_ms uint16_t 100 65535, Profile uint8_t 0 3 (Dimmer_Profile_t) */ \
+  /*  0 Linear (SetFadeTime), 1 Ease in, 2 Ease out, 3 S-curve, the profile is ignored when it is not within 0..3 */ \
+  X(SET_FADE_PROFILE,  0x13, 4, DIMMER_PARAM_NONE,  0, 0, 0, Command_SetFadeProfile) \
+  /* SetSequence Flags uint8_t, 4 keyframes DaliValue uint8_t 0 254, Time_ms uint16_t 0 65535 */ \
+  /*  Flags: bit 0..3 keyframes 0..4 (0 stops the sequence), bit 4..6 Profile (as SetFadeProfile), bit 7 loop */ \
+  /*  Fades to every keyframe in its time, a keyframe with the DaliValue of the one before holds it for its time */ \
+  /*  Stopped by all other Set and Fade commands of the dimmer, too long to be queued (0x13) */ \
+  X(SET_SEQUENCE,      0x14, 13, DIMMER_PARAM_NONE, 0, 0, 0, Command_SetSequence) \
+  /* GetSequence uint8_t, keyframe being faded to 1..4, 0 when no sequence is running */ \
+  X(GET_SEQUENCE,      0x94, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetSequence) \
+  /* Save MagicNumber uint8_t 0x55, returns at once, see GetSaveStatus */ \
+  X(SAVE,              0x30, 1, DIMMER_PARAM_MAGIC, DIMMER_CMD_SAVE_MAGIC_NUMBER, DIMMER_CMD_SAVE_MAGIC_NUMBER, 0, Command_Save) \
+  /* Load MagicNumber uint8_t 0x66 */ \
+  X(LOAD,              0x31, 1, DIMMER_PARAM_MAGIC, DIMMER_CMD_LOAD_MAGIC_NUMBER, DIMMER_CMD_LOAD_MAGIC_NUMBER, 0, Command_Load) \
+  /* LoadScratch MagicNumber uint8_t 0x77 */ \
+  X(LOAD_SCRATCH,      0x32, 1, DIMMER_PARAM_MAGIC, DIMMER_CMD_LOAD_SCRATCH_MAGIC_NUMBER, DIMMER_CMD_LOAD_SCRATCH_MAGIC_NUMBER, 0, Command_LoadScratch) \
+  /* SetMainzHz 50 or 60 uint8_t */ \
+  X(SET_MAINZ_HZ_VAL,  0x70, 1, DIMMER_PARAM_MAGIC, 50, 60, 0, Command_SetMainzHz) \
+  X(GET_MAINZ_HZ_VAL,  0xF0, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetMainzHz) \
+  /* SetTimerValue (stops all other actions) TimerValue uint16_t 0 20000 */ \
+  X(SET_TIMER_VAL,     0x71, 2, DIMMER_PARAM_TIMER, 0, 0, 0, Command_SetTimerValue) \
+  X(GET_TIMER_VAL,     0xF1, 0, DIMMER_PARAM_NONE,  0, 0, 2, Command_GetTimerValue) \
+  /* SetCalLowValue of the dimmer, OCR of Dali value 254 (use Save function) TimerValue uint16_t */ \
+  X(SET_CAL_LOW_VAL,   0x72, 2, DIMMER_PARAM_NONE,  0, 0, 0, Command_SetCalLow) \
+  X(GET_CAL_LOW_VAL,   0xF2, 0, DIMMER_PARAM_NONE,  0, 0, 2, Command_GetCalLow) \
+  /* SetCalHighValue of the dimmer, about the OCR of Dali value 1 (use Save function) TimerValue uint16_t */ \
+  X(SET_CAL_HIGH_VAL,  0x73, 2, DIMMER_PARAM_NONE,  0, 0, 0, Command_SetCalHigh) \
+  X(GET_CAL_HIGH_VAL,  0xF3, 0, DIMMER_PARAM_NONE,  0, 0, 2, Command_GetCalHigh) \
+  /* GetCalRange, 20000 for 50Hz and 16666 for 60Hz */ \
+  X(GET_CAL_RANGE_VAL, 0xF4, 0, DIMMER_PARAM_NONE,  0, 0, 2, Command_GetCalRange) \
+  /* GetCycle, current Dimmer cycle (half periods since start) uint32_t */ \
+  X(GET_CYCLE,         0xF5, 0, DIMMER_PARAM_NONE,  0, 0, 4, Command_GetCycle) \
+  /* GetMonitor Select uint8_t 0 5, main loop scheduler run time in Timer1 ticks (0.5 uS) */ \
+  /*  0 Dimmer, 1 USARTP, 2 Command: Max uint16_t Average uint16_t, 3: Missed cycles (lookahead ring underruns, zero crossings without a new value) uint32_t */ \
+  /*  4: Dropped TX bytes, Protocol uint16_t Debug uint16_t, 5: Zero crossing edges rejected as glitch uint32_t */ \
+  X(GET_MONITOR,       0xF6, 1, DIMMER_PARAM_MAGIC, 0, MonitorMAX+2, 4, Command_GetMonitor) \
+  /* GetSaveStatus uint8_t, 1 while Save is writing the EEPROM (in the background), 0 when done */ \
+  X(GET_SAVE_STATUS,   0xF7, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetSaveStatus) \
+  /* GetMains, tracked mains: Frequency uint16_t (50 or 60, 0 without lock) HalfPeriod uint16_t in Timer1 ticks (0 without lock) */ \
+  X(GET_MAINS,         0xF8, 0, DIMMER_PARAM_NONE,  0, 0, 4, Command_GetMains) \
+  /* GetCmdVersion Version uint8_t */ \
+  X(GET_CMD_VERSION,   0xF9, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetCmdVersion) \
+  /* GetVersion Version uint8_t */ \
+  X(GET_VERSION,       0xFA, 0, DIMMER_PARAM_NONE,  0, 0, 1, Command_GetVersion)
 
-#define DIMMER_CMD_SET_TIMER_VAL_ADDR         0x71 // 2 SetTimerValue (stops all other actions) TimerValue uint16_t 0 20000
-#define DIMMER_CMD_SET_TIMER_VAL_SIZE         4  
-#define DIMMER_CMD_GET_TIMER_VAL_ADDR         0xF1
-#define DIMMER_CMD_GET_TIMER_VAL_SIZE         0
-#define DIMMER_CMD_SET_CAL_LOW_VAL_ADDR       0x72
-#define DIMMER_CMD_SET_CAL_LOW_VAL_SIZE       4
-#define DIMMER_CMD_GET_CAL_LOW_VAL_ADDR       0xF2
-#define DIMMER_CMD_GET_CAL_LOW_VAL_SIZE       0
-#define DIMMER_CMD_SET_CAL_HIGH_VAL_ADDR      0x73 // 2 SetCalHigherValue (update Dali table) (use Save function) TimerValue uint16_t 0 20000
-#define DIMMER_CMD_SET_CAL_HIGH_VAL_SIZE      4
-#define DIMMER_CMD_GET_CAL_HIGH_VAL_ADDR      0xF3
-#define DIMMER_CMD_GET_CAL_HIGH_VAL_SIZE      0
-#define DIMMER_CMD_GET_CAL_RANGE_VAL_ADDR     0xF4 // GetCalRange, 20000 for 50Hz and 16666 for 60Hz
-#define DIMMER_CMD_GET_CAL_RANGE_VAL_SIZE     0
+#define DIMMER_CMD_ENUM(Name, Address, Size, Param, Min, Max, Reply, Handler) \
+  DIMMER_CMD_##Name##_ADDR = Address, \
+  DIMMER_CMD_##Name##_SIZE = (Size)*2,
 
-#define DIMMER_CMD_GET_CMD_VERSION_ADDR       0xF9	// 0 GetCmdVersion	Version	uint8_t 1
-#define DIMMER_CMD_GET_CMD_VERSION_SIZE       0
-
-#define DIMMER_CMD_GET_VERSION_ADDR           0xFA	// 0 GetVersion	Version	uint8_t 1
-#define DIMMER_CMD_GET_VERSION_SIZE           0
+enum {
+  DIMMER_CMD_LIST(DIMMER_CMD_ENUM)
+};
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,230 @@
+/*
+ * DimmerHost.cpp
+ */
+
+// Linux build of the sketch against the virtual ATmega328P of HAL_Host.c
+// Usage: DimmerHost [HalfCycles] [MainsHz] [LoopTicks] [DebugLoad] [Drift] [Noise] [Jitter] [Latency] [Stall] < SerialInput
+//  MainsHz is the frequency of the zero crossings, for example 50, 60 or 49.8
+//  LoopTicks is the virtual time of one loop() pass (default HOST_LOOP_TICKS)
+//  DebugLoad is the number of '.' debug bytes written every loop() pass, to test the answers under a saturated debug output
+//  Drift in ticks, the half period drifts up and down by Drift (triangle of HOST_DRIFT_CYCLES half cycles)
+//  Noise is the number of noise edges on the zero crossing input per 1000 half cycles, at random times
+//  Jitter, the zero crossing detector edge comes 0..Jitter ticks after the zero crossing
+//  Latency, the capture Irq starts 0..Latency ticks after the edge
+//  Stall in ticks, one loop() pass every HOST_STALL_CYCLES half cycles takes this long (a flush or an EEPROM write)
+//  The firing times after the zero crossing are measured in the second half of the run (after the fades and the lock)
+//  SerialInput is sent to the dimmer at 9600 baud, everything the dimmer sends is written to stdout
+//  Statistics are written to stderr when done
+
+#if defined(HAL_HOST)
+
+#include "HAL.h"
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+#include "DimmerAVR.ino"
+
+#define HOST_LOOP_TICKS 20 // Virtual time of one loop() pass, 10 uS
+#define HOST_DRIFT_CYCLES 4000 // Period of the drift of the half period, 40 seconds at 50 Hz
+#define HOST_STALL_CYCLES 50 // Half cycles between two stalled loop() passes
+
+static const char *Host_MonitorName[MonitorMAX] = { "Dimmer", "USARTP", "Command" };
+
+#define HOST_ACK 6   // As COM_ACK, COM_NAK and COM_STX of Command.cpp
+#define HOST_NAK 21
+#define HOST_STX '#'
+
+static uint32_t Host_TxBytes = 0;
+static uint32_t Host_TxAck = 0;
+static uint32_t Host_TxNak = 0;
+static uint32_t Host_TxReplies = 0;
+
+static void Host_TxOutput(uint8_t Value) {
+  putchar(Value);
+  Host_TxBytes++;
+  if (Value == HOST_ACK) {
+    Host_TxAck++;
+  } else if (Value == HOST_NAK) {
+    Host_TxNak++;
+  } else if (Value == HOST_STX) {
+    Host_TxReplies++;
+  }
+}
+
+static uint32_t Host_Nanoseconds(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint32_t)(Now.tv_sec * 1000000000ULL + Now.tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t HalfCycles = 1000;
+  uint16_t HalfPeriod = 20000;
+  uint16_t LoopTicks = HOST_LOOP_TICKS;
+  uint16_t DebugLoad = 0;
+  uint16_t Drift = 0;
+  uint16_t Noise = 0;
+  uint16_t Jitter = 0;
+  uint16_t Latency = 0;
+  uint32_t Stall = 0;
+  uint32_t Stalls = 0;
+  uint16_t Fired[HAL_HOST_GATES][3] = { { 0 } }; // Last firing times, [0] is the newest
+  uint32_t Stutters[HAL_HOST_GATES] = { 0 };
+  uint32_t Pulses[HAL_HOST_GATES] = { 0 };
+  uint16_t FireMin[HAL_HOST_GATES];
+  uint16_t FireMax[HAL_HOST_GATES] = { 0 };
+  uint32_t FireCount[HAL_HOST_GATES] = { 0 };
+  double FireSum[HAL_HOST_GATES] = { 0 };
+  double FireSquares[HAL_HOST_GATES] = { 0 };
+  double FireMean;
+  uint16_t Period;
+  uint32_t Phase;
+  uint16_t Tracked;
+  uint16_t TrackError;
+  uint16_t TrackErrorMax = 0;
+  uint32_t LockedCycles = 0;
+  uint32_t Captures;
+  uint32_t Start;
+  uint32_t Work = 0;
+  uint32_t WorkMax = 0;
+  uint32_t WorkTotal = 0;
+  uint32_t Passes = 0;
+  int C;
+
+  if (argc > 1) {
+    HalfCycles = strtoul(argv[1], NULL, 0);
+  }
+  if (argc > 2) {
+    HalfPeriod = (uint16_t)(1000000.0 / strtod(argv[2], NULL) + 0.5);
+  }
+  if (argc > 3) {
+    LoopTicks = strtoul(argv[3], NULL, 0);
+  }
+  if (argc > 4) {
+    DebugLoad = strtoul(argv[4], NULL, 0);
+  }
+  if (argc > 5) {
+    Drift = strtoul(argv[5], NULL, 0);
+  }
+  if (argc > 6) {
+    Noise = strtoul(argv[6], NULL, 0);
+  }
+  if (argc > 7) {
+    Jitter = strtoul(argv[7], NULL, 0);
+  }
+  if (argc > 8) {
+    Latency = strtoul(argv[8], NULL, 0);
+  }
+  if (argc > 9) {
+    Stall = strtoul(argv[9], NULL, 0);
+  }
+  for (uint8_t i = 0; i < HAL_HOST_GATES; i++) {
+    FireMin[i] = 0xFFFF;
+  }
+
+  Period = HalfPeriod;
+  HAL_Host_Initialize(HalfPeriod);
+  HAL_Host_SetDetector(Jitter, Latency);
+  HAL_Host_SetTxOutput(Host_TxOutput);
+  setup();
+  // The serial input starts after the start-up, as a controller waits for the dimmer
+  while ((C = getchar()) != EOF) {
+    HAL_Host_RxInject((uint8_t)C);
+  }
+  Captures = HAL_Host_Stats.Captures;
+  while (HAL_Host_Stats.Captures < HalfCycles) {
+    Start = Host_Nanoseconds();
+    loop();
+    Work += Host_Nanoseconds() - Start;
+    for (uint16_t i = 0; i < DebugLoad; i++) {
+      USARTP_WriteDebug('.');
+    }
+    Passes++;
+    if ((Stall != 0) && (HAL_Host_Stats.Captures / HOST_STALL_CYCLES != Stalls)) {
+      Stalls = HAL_Host_Stats.Captures / HOST_STALL_CYCLES;
+      HAL_Host_Advance(Stall);
+    } else {
+      HAL_Host_Advance(LoopTicks);
+    }
+    if (HAL_Host_Stats.Captures != Captures) {
+      // Host time of all loop() passes of the last half cycle
+      Captures = HAL_Host_Stats.Captures;
+      WorkTotal += Work;
+      if (Work > WorkMax) {
+        WorkMax = Work;
+      }
+      Work = 0;
+      // Period of the mains is the period of the half cycle that just started, the tracker lags behind
+      Period = HalfPeriod;
+      if (Drift != 0) {
+        Phase = Captures % HOST_DRIFT_CYCLES;
+        if (Phase >= HOST_DRIFT_CYCLES / 2) {
+          Phase = HOST_DRIFT_CYCLES - Phase;
+        }
+        Period = HalfPeriod - Drift + (uint16_t)((Phase * 4 * Drift) / HOST_DRIFT_CYCLES);
+        HAL_Host_SetHalfPeriod(Period);
+      }
+      if ((Noise != 0) && ((uint32_t)(rand() % 1000) < Noise)) {
+        HAL_Host_Glitch(rand() % Period);
+      }
+      for (uint8_t i = 0; i < HAL_HOST_GATES; i++) {
+        if ((HAL_Host_Stats.GatePulses[i] != Pulses[i]) && (Captures > HalfCycles / 2)) {
+          if (HAL_Host_Stats.GateOnZero[i] < FireMin[i]) {
+            FireMin[i] = HAL_Host_Stats.GateOnZero[i];
+          }
+          if (HAL_Host_Stats.GateOnZero[i] > FireMax[i]) {
+            FireMax[i] = HAL_Host_Stats.GateOnZero[i];
+          }
+          FireCount[i]++;
+          FireSum[i] += HAL_Host_Stats.GateOnZero[i];
+          FireSquares[i] += (double)HAL_Host_Stats.GateOnZero[i] * HAL_Host_Stats.GateOnZero[i];
+        }
+        // A stutter is one half cycle on the firing time of the one before, in between moving firing times (a fade)
+        if (HAL_Host_Stats.GatePulses[i] != Pulses[i]) {
+          if ((Fired[i][2] != Fired[i][1]) && (Fired[i][1] == Fired[i][0]) && (Fired[i][0] != HAL_Host_Stats.GateOnZero[i])) {
+            Stutters[i]++;
+          }
+          Fired[i][2] = Fired[i][1];
+          Fired[i][1] = Fired[i][0];
+          Fired[i][0] = HAL_Host_Stats.GateOnZero[i];
+        }
+        Pulses[i] = HAL_Host_Stats.GatePulses[i];
+      }
+      if (Mains_Locked()) {
+        LockedCycles++;
+        Tracked = Mains_GetHalfPeriod();
+        TrackError = (Tracked > Period) ? (Tracked - Period) : (Period - Tracked);
+        if (TrackError > TrackErrorMax) {
+          TrackErrorMax = TrackError;
+        }
+      }
+    }
+  }
+  fflush(stdout);
+
+  fprintf(stderr, "Half cycles %u, virtual time %u ticks, loop passes %u\n", HAL_Host_Stats.Captures, HAL_Host_Stats.Time, Passes);
+  fprintf(stderr, "Work per half cycle: avg %u ns, max %u ns\n", WorkTotal / (HAL_Host_Stats.Captures ? HAL_Host_Stats.Captures : 1), WorkMax);
+  for (uint8_t i = 0; i < HAL_HOST_GATES; i++) {
+    if (HAL_Host_Stats.GatePulses[i] != 0) {
+      FireMean = FireCount[i] ? FireSum[i] / FireCount[i] : 0;
+      fprintf(stderr, "Gate %u: pulses %u (half cycle %u..%u), last gate on %u ticks, fired %u..%u ticks after the zero crossing (jitter %.1f ticks rms), stutters %u\n", i, HAL_Host_Stats.GatePulses[i], HAL_Host_Stats.GateFirst[i], HAL_Host_Stats.GateLast[i], HAL_Host_Stats.GateOn[i], FireMin[i], FireMax[i],
+        FireCount[i] ? sqrt(FireSquares[i] / FireCount[i] - FireMean * FireMean) : 0.0, Stutters[i]);
+    }
+  }
+  fprintf(stderr, "Mains %u Hz, half period %u ticks (zero crossings %u), locked %u half cycles, max error %u ticks, unlocks %u\n", Mains_GetHz(), Mains_GetHalfPeriod(), Period, LockedCycles, TrackErrorMax, Mains_GetUnlocks());
+  if (HAL_Host_Stats.Glitches != 0) {
+    fprintf(stderr, "Noise edges %u, rejected %u\n", HAL_Host_Stats.Glitches, Monitor_GetRejectedCaptures());
+  }
+  fprintf(stderr, "Capture Irq: zero crossing max %u ns, average %u ns", HAL_Host_Stats.CaptureNsMax, (uint32_t)(HAL_Host_Stats.CaptureNsSum / (HAL_Host_Stats.Captures ? HAL_Host_Stats.Captures : 1)));
+  fprintf(stderr, ", noise edge max %u ns, average %u ns\n", HAL_Host_Stats.GlitchNsMax, (uint32_t)(HAL_Host_Stats.GlitchNsSum / (HAL_Host_Stats.Glitches ? HAL_Host_Stats.Glitches : 1)));
+  fprintf(stderr, "RX overrun %u, EEPROM writes %u\n", HAL_Host_Stats.RxOverrun, HAL_Host_Stats.EEPROMWrites);
+  for (uint8_t i = 0; i < MonitorMAX; i++) {
+    fprintf(stderr, "%s scheduler: max %lu ns, average %u ns\n", Host_MonitorName[i], (unsigned long)Monitor_GetMax((Monitor_Select_t)i), Monitor_GetAverage((Monitor_Select_t)i));
+  }
+  fprintf(stderr, "Missed cycles %u\n", Monitor_GetMissedCycles());
+  fprintf(stderr, "TX bytes %u (ACK %u, NAK %u, STX %u), dropped protocol %u, debug %u\n", Host_TxBytes, Host_TxAck, Host_TxNak, Host_TxReplies, USARTP_GetDrops(), USARTP_GetDebugDrops());
+  return 0;
+}
+
+#endif // HAL_HOST
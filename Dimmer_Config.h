@@ -9,18 +9,81 @@
 extern "C" {
 #endif
 
-#include "Arduino.h"
+#include "HAL.h"
 #include "Settings.h"
+#include "Command.h"
+#include "Monitor.h"
+#include "Mains.h"
 
 #define DEBUG_DIMMER
-//#define DEBUG_DIMMER_DALI
+//#define DEBUG_DIMMER_DALI // Shows the OCR values of all Dali values of every channel
 
 //#define DEBUG_DIMMER_DEMO
 
-#define DIMMER_VERSION  0
+//#define DEBUG_DIMMER_BENCHMARK
+#define DIMMER_BENCHMARK_STRIDE 17 // Start and End brightness step of the fade benchmark, 1 is all combinations
 
-#define ExternalDimmer_MAINS_HZ Settings.MainzHZ
-#define ExternalDimmer_RangeDefault Settings.RangeMin
+#define DIMMER_VERSION  1 // Version of the Settings, 1 calibration per channel
+
+// Number of triac channels on one zero crossing input
+// Without DIMMER_SORTED_SCHEDULER every channel owns a Timer1 compare output (OC1A D9, OC1B D10), so exactly 2
+// With DIMMER_SORTED_SCHEDULER a sorted firing list is walked by OCR1A and the gates are GPIOs (up to 8)
+#define DIMMER_CHANNELS 2
+//#define DIMMER_SORTED_SCHEDULER
+
+// Gate GPIO of channel 0..7 for DIMMER_SORTED_SCHEDULER, D9, D10, D2..D7
+#define DIMMER_GATE_PORTB { (1<<PORTB1), (1<<PORTB2), 0, 0, 0, 0, 0, 0 }
+#define DIMMER_GATE_PORTD { 0, 0, (1<<PORTD2), (1<<PORTD3), (1<<PORTD4), (1<<PORTD5), (1<<PORTD6), (1<<PORTD7) }
+// Events closer than this are fired by one compare Irq, must be longer than the OCR1A Irq itself
+#define DIMMER_EVENT_MIN_TICKS 16 // 8 uS
+
+// Half periods of firing values Dimmer_Scheduler calculates ahead (lookahead ring), filled in the main loop passes
+// A main loop pass may take this many half periods without a lost fade step, commands take effect this much later
+#define DIMMER_LOOKAHEAD 4
+
+// Keyframes of a fade sequence per channel, all of them are loaded with one SetSequence command (DimmerCmdList.h)
+#define DIMMER_SEQUENCE_SIZE 4
+
+#if defined(DIMMER_SORTED_SCHEDULER)
+#if (DIMMER_CHANNELS < 1) || (DIMMER_CHANNELS > 8)
+#error "DIMMER_SORTED_SCHEDULER supports 1 to 8 channels"
+#endif
+#elif (DIMMER_CHANNELS != 2)
+#error "Without DIMMER_SORTED_SCHEDULER there are exactly 2 channels (OC1A and OC1B)"
+#endif
+#if (DIMMER_CHANNELS > SETTINGS_CHANNELS)
+#error "Every channel needs a calibration, SETTINGS_CHANNELS (Settings_CFG.h) is too small"
+#endif
+
+#define ExternalDimmer_MAINS_HZ Settings.MainzHZ // Calibrated mains, used until the tracker has a lock
+#define ExternalDimmer_MainsUpdate(HalfPeriod) Mains_Update(HalfPeriod) // Every new cycle, the last captured half period
+#define ExternalDimmer_MainsHalfPeriod() Mains_GetHalfPeriod() // Tracked half period in Timer1 ticks, 0 without lock
+#define ExternalDimmer_RangeMin(Select) Settings.RangeMin[Select] // Calibration of the channel, OCR of Dali value 254
+#define ExternalDimmer_RangeMax(Select) Settings.RangeMax[Select] // About the OCR of Dali value 1
+#define ExternalDimmer_CycleHook(Cycle) Command_QueueScheduler(Cycle) // Every new cycle, before the dimmers are calculated
+#define ExternalDimmer_MissedCyclesHook(Count) Monitor_MissedCycles(Count) // Zero crossings without a new firing value, the lookahead ring was empty
+#define ExternalDimmer_RejectedHook(Count) Monitor_RejectedCaptures(Count) // Capture edges rejected as glitch
+
+// Capture glitch rejection, an edge earlier than the window of the next zero crossing does not start a cycle
+// The window opens HalfPeriod/DIMMER_CAPTURE_WINDOW before the tracked zero crossing, later edges are always accepted
+#define DIMMER_CAPTURE_WINDOW   16
+#define DIMMER_CAPTURE_MIN      12000 // Ticks, window without a tracked mains (83 Hz)
+
+// Predictive firing, the gates fire relative to the predicted zero crossing instead of the captured edge
+// Timer1 counts from the edge (ICR1), so the capture Irq latency is not in the firing times
+// The zero crossing is predicted from the last one and a half period, both follow the edges slowly (Dimmer_PredictZero),
+// which filters the detector jitter out of the firing times
+// Without a lock on the mains (Mains.c) the gates fire relative to the edge
+//#define DIMMER_PREDICTIVE_FIRING
+#define DIMMER_DETECTOR_OFFSET  0   // Ticks from the detector edge to the zero crossing, negative when the edge comes late
+#define DIMMER_PREDICT_SHIFT    3
+#define DIMMER_PREDICT_MAX      400 // Ticks, an edge further from the prediction starts again from the edge
+#define DIMMER_PREDICT_MIN_OCR  64  // Ticks, earliest firing time after the edge
+
+// Temporal dithering of a fade, the fraction of a Timer1 tick dropped by the interpolation between two Dali values
+// is carried to the next half periods (first order sigma-delta, Dimmer_FadeTicks)
+// At the low end the Dali values are only a few ticks apart, a slow fade then moves in 1/256 tick steps on average
+//#define DIMMER_DITHERING
 
 #define Dimmer_PulseWidth 50 // uS
 
@@ -0,0 +1,14 @@
+/*
+ * FadeLut.c
+ */
+
+#include "FadeLut.h"
+
+const PROGMEM uint16_t LUT_FADE[LUT_FADE_Profiles][LUT_FADE_Points] = {
+  // Ease in, x^3
+  { 0, 2, 16, 54, 128, 250, 432, 686, 1024, 1458, 2000, 2662, 3456, 4394, 5488, 6750, 8192, 9826, 11664, 13718, 16000, 18522, 21296, 24334, 27648, 31250, 35151, 39365, 43903, 48777, 53999, 59581, 65535 },
+  // Ease out, 1-(1-x)^3
+  { 0, 5954, 11536, 16758, 21632, 26170, 30384, 34285, 37887, 41201, 44239, 47013, 49535, 51817, 53871, 55709, 57343, 58785, 60047, 61141, 62079, 62873, 63535, 64077, 64511, 64849, 65103, 65285, 65407, 65481, 65519, 65533, 65535 },
+  // S-curve, 3x^2-2x^3
+  { 0, 188, 736, 1620, 2816, 4300, 6048, 8036, 10240, 12636, 15200, 17908, 20736, 23660, 26656, 29700, 32768, 35835, 38879, 41875, 44799, 47627, 50335, 52899, 55295, 57499, 59487, 61235, 62719, 63915, 64799, 65347, 65535 },
+};
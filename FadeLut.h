@@ -0,0 +1,26 @@
+/*
+ * FadeLut.h
+ */
+
+#ifndef _FADE_LUT_H
+#define _FADE_LUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "HAL.h"
+
+// Easing curves of a fade, brightness part done (0..65535) of the time part done, linear in between the points
+#define LUT_FADE_Profiles 3  // Ease in, ease out, S-curve (Dimmer_Profile_t without linear)
+#define LUT_FADE_Points   33 // 32 segments, time part done 0..65535 in steps of 2048
+#define LUT_FADE_Segment_Bits 11
+
+extern const uint16_t LUT_FADE[LUT_FADE_Profiles][LUT_FADE_Points];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FADE_LUT_H */
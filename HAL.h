@@ -0,0 +1,43 @@
+/*
+ * HAL.h
+ */
+
+#ifndef _HAL_H
+#define _HAL_H
+
+// Timer1, GPIO and the USART configuration registers are used directly (ATmega328P names)
+// USART data, EEPROM and benchmark timing go through the HAL_ functions/macros
+// With HAL_HOST defined all of it is virtual, see HAL_Host.h
+
+#if defined(HAL_HOST)
+#include "HAL_Host.h"
+#else
+#include "Arduino.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+
+#define HAL_USART_RxReady()           (UCSR0A & (1 << RXC0))
+#define HAL_USART_RxData()            UDR0
+#define HAL_USART_TxReady()           (UCSR0A & (1 << UDRE0))
+#define HAL_USART_TxData(Value)       UDR0 = (Value)
+
+#define HAL_EEPROM_Get(Address, pData, Size) eeprom_read_block((void *)(pData), (const void *)(Address), (Size))
+#define HAL_EEPROM_Put(Address, pData, Size) eeprom_update_block((const void *)(pData), (void *)(Address), (Size))
+// Non blocking byte access, only when HAL_EEPROM_Ready (a write takes 3.3 mS)
+#define HAL_EEPROM_Ready()                   eeprom_is_ready()
+#define HAL_EEPROM_ReadByte(Address)         eeprom_read_byte((const uint8_t *)(Address))
+#define HAL_EEPROM_WriteByte(Address, Value) eeprom_write_byte((uint8_t *)(Address), (Value))
+
+// Timer1 ticks (0.5 uS), only valid while there is no capture (TCNT1 is reset on every zero crossing)
+typedef uint16_t HAL_Bench_t;
+#define HAL_BenchTicks()              ((HAL_Bench_t)TCNT1)
+// CPU cycles of a HAL_BenchTicks interval, Timer1 runs at F_CPU/8
+#define HAL_BenchCycles(Ticks)        ((uint32_t)(Ticks) * 8)
+#define HAL_BENCH_UNIT                "CPU cycles"
+// Range of HAL_BenchTicks, when a capture happened in between it is the last half period
+#define HAL_BenchPeriod(HalfPeriod)   (HalfPeriod)
+#endif
+
+#endif /* _HAL_H */
@@ -0,0 +1,355 @@
+/*
+ * HAL_Host.c
+ */
+
+#if defined(HAL_HOST)
+
+#include "HAL.h"
+#include <string.h>
+#include <time.h>
+
+#define HAL_HOST_RX_QUEUE_SIZE 32768
+
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint16_t ICR1;
+volatile uint8_t  TCCR1A;
+volatile uint8_t  TCCR1B;
+volatile uint8_t  TCCR1C;
+volatile uint8_t  TIMSK1;
+volatile uint8_t  TIFR1;
+volatile uint8_t  TIMSK0;
+volatile uint8_t  DDRB;
+volatile uint8_t  PORTB;
+volatile uint8_t  DDRD;
+volatile uint8_t  PORTD;
+volatile uint8_t  UCSR0A;
+volatile uint8_t  UCSR0B;
+volatile uint8_t  UCSR0C;
+volatile uint16_t UBRR0;
+
+HAL_Host_Stats_t HAL_Host_Stats;
+
+// Irqs not used by the sketch
+__attribute__((weak)) void TIMER1_CAPT_vect(void) {}
+__attribute__((weak)) void TIMER1_COMPA_vect(void) {}
+__attribute__((weak)) void TIMER1_COMPB_vect(void) {}
+
+typedef struct {
+  uint16_t HalfPeriod;
+  uint32_t NextZeroCross;
+  uint32_t ZeroCross;     // Time of the last zero crossing of the mains
+  uint32_t NextEdge;      // Edge of the zero crossing detector on ICP1
+  uint16_t EdgeJitter;
+  uint16_t IrqLatency;
+  uint32_t IrqTime;       // Capture Irq of the last edge
+  uint8_t  IrqPending;
+  uint32_t IrqEnd;        // End of the running Irq, no other Irq starts before it
+  uint8_t  ComparePending[2]; // Compare Irq A and B after their match
+  uint32_t CompareTime[2];  // Port writes of the compare Irq
+  uint8_t  IrqGlitch;
+  uint32_t GlitchTime;
+  uint8_t  GlitchPending;
+  uint16_t RxQueueHead;
+  uint16_t RxQueueTail;
+  uint8_t  RxQueue[HAL_HOST_RX_QUEUE_SIZE];
+  uint32_t RxNextTime;
+  uint8_t  RxData;
+  uint8_t  RxFull;
+  uint32_t TxReadyTime;
+  void (*pTxOutput)(uint8_t Value);
+  uint8_t  EEPROM[HAL_HOST_EEPROM_SIZE];
+  uint32_t EEPROMReadyTime;
+} HAL_Host_t;
+
+static HAL_Host_t Host;
+
+static void HAL_Host_Compare(uint8_t Channel, uint8_t COM);
+static void HAL_Host_Edge(uint8_t Glitch);
+static uint32_t HAL_Host_Capture(void);
+static void HAL_Host_GateEdges(void);
+static void HAL_Host_Match(uint8_t Channel);
+
+void HAL_Host_Initialize(uint16_t HalfPeriod) {
+  memset(&Host, 0, sizeof(Host));
+  memset(&HAL_Host_Stats, 0, sizeof(HAL_Host_Stats));
+  memset(Host.EEPROM, 0xFF, sizeof(Host.EEPROM)); // Erased
+  Host.HalfPeriod = HalfPeriod;
+  Host.NextZeroCross = HalfPeriod;
+  Host.NextEdge = HalfPeriod;
+}
+
+// 0 stops the zero crossings (no mains)
+void HAL_Host_SetHalfPeriod(uint16_t HalfPeriod) {
+  if (Host.HalfPeriod == 0) {
+    Host.NextZeroCross = HAL_Host_Stats.Time + HalfPeriod;
+    Host.NextEdge = Host.NextZeroCross;
+  }
+  Host.HalfPeriod = HalfPeriod;
+}
+
+// The detector edge comes 0..EdgeJitter ticks after the zero crossing and the capture Irq
+// starts 0..IrqLatency ticks after the edge (another Irq running), random per zero crossing
+void HAL_Host_SetDetector(uint16_t EdgeJitter, uint16_t IrqLatency) {
+  Host.EdgeJitter = EdgeJitter;
+  Host.IrqLatency = IrqLatency;
+}
+
+// A noise edge on ICP1 Delay ticks from now, one at a time
+void HAL_Host_Glitch(uint32_t Delay) {
+  Host.GlitchTime = HAL_Host_Stats.Time + Delay;
+  Host.GlitchPending = 1;
+}
+
+void HAL_Host_SetTxOutput(void (*pOutput)(uint8_t Value)) {
+  Host.pTxOutput = pOutput;
+}
+
+// Characters are delivered one per HAL_HOST_BAUD_TICKS, like a continuously sending controller
+void HAL_Host_RxInject(uint8_t Value) {
+  uint16_t i;
+  i = (Host.RxQueueHead + 1) % HAL_HOST_RX_QUEUE_SIZE;
+  if (i != Host.RxQueueTail) {
+    if (Host.RxQueueHead == Host.RxQueueTail) {
+      Host.RxNextTime = HAL_Host_Stats.Time + HAL_HOST_BAUD_TICKS;
+    }
+    Host.RxQueue[Host.RxQueueHead] = Value;
+    Host.RxQueueHead = i;
+  }
+}
+
+// Runs the virtual Timer1, zero crossing and USART receiver for Ticks, calling the ISRs on their events
+void HAL_Host_Advance(uint32_t Ticks) {
+  uint32_t End;
+  uint32_t Step;
+  uint32_t Nanoseconds;
+
+  End = HAL_Host_Stats.Time + Ticks;
+  while (HAL_Host_Stats.Time != End) {
+    Step = End - HAL_Host_Stats.Time;
+    if ((Host.HalfPeriod != 0) && ((Host.NextZeroCross - HAL_Host_Stats.Time) < Step)) {
+      Step = Host.NextZeroCross - HAL_Host_Stats.Time;
+    }
+    if ((Host.HalfPeriod != 0) && ((Host.NextEdge - HAL_Host_Stats.Time) < Step)) {
+      Step = Host.NextEdge - HAL_Host_Stats.Time;
+    }
+    if (Host.IrqPending && ((Host.IrqTime - HAL_Host_Stats.Time) < Step)) {
+      Step = Host.IrqTime - HAL_Host_Stats.Time;
+    }
+    if (Host.GlitchPending && ((Host.GlitchTime - HAL_Host_Stats.Time) < Step)) {
+      Step = Host.GlitchTime - HAL_Host_Stats.Time;
+    }
+    if ((TIMSK1 & (1<<OCIE1A)) && (OCR1A > TCNT1) && ((uint32_t)(OCR1A - TCNT1) < Step)) {
+      Step = OCR1A - TCNT1;
+    }
+    if ((TIMSK1 & (1<<OCIE1B)) && (OCR1B > TCNT1) && ((uint32_t)(OCR1B - TCNT1) < Step)) {
+      Step = OCR1B - TCNT1;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+      if (Host.ComparePending[i] && ((Host.CompareTime[i] - HAL_Host_Stats.Time) < Step)) {
+        Step = Host.CompareTime[i] - HAL_Host_Stats.Time;
+      }
+    }
+    if ((Host.RxQueueHead != Host.RxQueueTail) && ((Host.RxNextTime - HAL_Host_Stats.Time) < Step)) {
+      Step = Host.RxNextTime - HAL_Host_Stats.Time;
+    }
+
+    HAL_Host_Stats.Time += Step;
+    TCNT1 += Step;
+
+    if ((Host.HalfPeriod != 0) && (HAL_Host_Stats.Time == Host.NextZeroCross)) {
+      Host.ZeroCross = HAL_Host_Stats.Time;
+      Host.NextZeroCross += Host.HalfPeriod;
+    }
+    if ((Host.HalfPeriod != 0) && (HAL_Host_Stats.Time == Host.NextEdge)) {
+      Host.NextEdge = Host.NextZeroCross + (Host.EdgeJitter ? (uint32_t)rand() % (Host.EdgeJitter + 1) : 0);
+      HAL_Host_Stats.Captures++;
+      HAL_Host_Edge(0);
+    } else if (Host.GlitchPending && (HAL_Host_Stats.Time == Host.GlitchTime)) {
+      Host.GlitchPending = 0;
+      HAL_Host_Stats.Glitches++;
+      HAL_Host_Edge(1);
+    }
+    if (Host.IrqPending && (HAL_Host_Stats.Time == Host.IrqTime) && ((int32_t)(Host.IrqEnd - HAL_Host_Stats.Time) > 0)) {
+      Host.IrqTime = Host.IrqEnd; // A compare Irq is running
+    }
+    if (Host.IrqPending && (HAL_Host_Stats.Time == Host.IrqTime)) {
+      Host.IrqPending = 0;
+      Host.IrqEnd = HAL_Host_Stats.Time + HAL_HOST_CAPTURE_TICKS;
+      Nanoseconds = HAL_Host_Capture();
+      if (Host.IrqGlitch == 0) {
+        HAL_Host_Stats.CaptureNsSum += Nanoseconds;
+        if (Nanoseconds > HAL_Host_Stats.CaptureNsMax) {
+          HAL_Host_Stats.CaptureNsMax = Nanoseconds;
+        }
+      } else {
+        HAL_Host_Stats.GlitchNsSum += Nanoseconds;
+        if (Nanoseconds > HAL_Host_Stats.GlitchNsMax) {
+          HAL_Host_Stats.GlitchNsMax = Nanoseconds;
+        }
+      }
+    }
+    if ((TIMSK1 & (1<<OCIE1A)) && (TCNT1 == OCR1A) && !Host.ComparePending[0]) {
+      HAL_Host_Compare(0, (TCCR1A >> COM1A0) & 3);
+      HAL_Host_Match(0);
+    }
+    if ((TIMSK1 & (1<<OCIE1B)) && (TCNT1 == OCR1B) && !Host.ComparePending[1]) {
+      HAL_Host_Compare(1, (TCCR1A >> COM1B0) & 3);
+      HAL_Host_Match(1);
+    }
+    if (Host.ComparePending[0] && (HAL_Host_Stats.Time == Host.CompareTime[0])) {
+      Host.ComparePending[0] = 0;
+      TIMER1_COMPA_vect();
+    }
+    if (Host.ComparePending[1] && (HAL_Host_Stats.Time == Host.CompareTime[1])) {
+      Host.ComparePending[1] = 0;
+      TIMER1_COMPB_vect();
+    }
+    if ((Host.RxQueueHead != Host.RxQueueTail) && (HAL_Host_Stats.Time == Host.RxNextTime)) {
+      if (Host.RxFull) {
+        HAL_Host_Stats.RxOverrun++;
+      }
+      Host.RxData = Host.RxQueue[Host.RxQueueTail];
+      Host.RxFull = 1;
+      Host.RxQueueTail = (Host.RxQueueTail + 1) % HAL_HOST_RX_QUEUE_SIZE;
+      Host.RxNextTime = HAL_Host_Stats.Time + HAL_HOST_BAUD_TICKS;
+    }
+    HAL_Host_GateEdges();
+  }
+}
+
+// Compare match, the Irq starts now or when the running Irq ends
+static void HAL_Host_Match(uint8_t Channel) {
+  uint32_t Start = HAL_Host_Stats.Time;
+
+  if ((int32_t)(Host.IrqEnd - Start) > 0) {
+    Start = Host.IrqEnd;
+  }
+  Host.ComparePending[Channel] = 1;
+  Host.CompareTime[Channel] = Start + HAL_HOST_IRQ_ENTRY_TICKS;
+  Host.IrqEnd = Start + HAL_HOST_COMPARE_TICKS;
+}
+
+// Edge on ICP1, ICR1 captures TCNT1 and the capture Irq follows after the Irq latency
+static void HAL_Host_Edge(uint8_t Glitch) {
+  ICR1 = TCNT1;
+  Host.IrqPending = 1;
+  Host.IrqGlitch = Glitch;
+  Host.IrqTime = HAL_Host_Stats.Time + (Host.IrqLatency ? (uint32_t)rand() % (Host.IrqLatency + 1) : 0);
+}
+
+// Capture Irq, returns its host time in nanoseconds
+static uint32_t HAL_Host_Capture(void) {
+  struct timespec Start;
+  struct timespec End;
+
+  if ((TIMSK1 & (1<<ICIE1)) == 0) {
+    return 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &Start);
+  TIMER1_CAPT_vect();
+  clock_gettime(CLOCK_MONOTONIC, &End);
+  return (uint32_t)((End.tv_sec - Start.tv_sec) * 1000000000LL + (End.tv_nsec - Start.tv_nsec));
+}
+
+// Rising edges on the gate outputs, by compare output or by GPIO writes in an Irq
+static void HAL_Host_GateEdges(void) {
+  static uint16_t Previous = 0;
+  uint16_t Gates;
+  uint16_t Rising;
+
+  Gates = ((PORTB >> PORTB1) & 0x03) | ((uint16_t)(PORTD >> PORTD2) << 2);
+  Rising = Gates & ~Previous;
+  Previous = Gates;
+  for (uint8_t i = 0; i < HAL_HOST_GATES; i++) {
+    if (Rising & (1 << i)) {
+      if (HAL_Host_Stats.GatePulses[i] == 0) {
+        HAL_Host_Stats.GateFirst[i] = HAL_Host_Stats.Captures;
+      }
+      HAL_Host_Stats.GateLast[i] = HAL_Host_Stats.Captures;
+      HAL_Host_Stats.GatePulses[i]++;
+      HAL_Host_Stats.GateOn[i] = TCNT1;
+      HAL_Host_Stats.GateOnZero[i] = HAL_Host_Stats.Time - Host.ZeroCross;
+    }
+  }
+}
+
+// Compare output mode, 2 clears and 3 sets OC1A (PORTB1) / OC1B (PORTB2)
+static void HAL_Host_Compare(uint8_t Channel, uint8_t COM) {
+  uint8_t Pin = (1 << (PORTB1 + Channel));
+  if (COM == 3) {
+    PORTB |= Pin;
+  } else if (COM == 2) {
+    PORTB &= ~Pin;
+  }
+}
+
+uint8_t HAL_USART_RxReady(void) {
+  return Host.RxFull;
+}
+
+uint8_t HAL_USART_RxData(void) {
+  Host.RxFull = 0;
+  return Host.RxData;
+}
+
+// Polling a busy transmitter costs a tick, so blocking waits (USARTP_FlushTX_Buffer) let virtual time pass
+uint8_t HAL_USART_TxReady(void) {
+  if ((int32_t)(HAL_Host_Stats.Time - Host.TxReadyTime) >= 0) {
+    return 1;
+  }
+  HAL_Host_Advance(1);
+  return 0;
+}
+
+void HAL_USART_TxData(uint8_t Value) {
+  Host.TxReadyTime = HAL_Host_Stats.Time + HAL_HOST_BAUD_TICKS;
+  if (Host.pTxOutput != NULL) {
+    Host.pTxOutput(Value);
+  }
+}
+
+void HAL_EEPROM_Get(uint16_t Address, void *pData, uint16_t Size) {
+  memcpy(pData, &Host.EEPROM[Address % HAL_HOST_EEPROM_SIZE], Size);
+}
+
+// Blocking like eeprom_update_block, only changed bytes are written, interrupts keep running
+void HAL_EEPROM_Put(uint16_t Address, const void *pData, uint16_t Size) {
+  const uint8_t *pValue = (const uint8_t *)pData;
+  for (uint16_t i = 0; i < Size; i++) {
+    uint16_t Index = (Address + i) % HAL_HOST_EEPROM_SIZE;
+    if (Host.EEPROM[Index] != pValue[i]) {
+      Host.EEPROM[Index] = pValue[i];
+      HAL_Host_Stats.EEPROMWrites++;
+      HAL_Host_Advance(HAL_HOST_EEPROM_WRITE_TICKS);
+    }
+  }
+}
+
+uint8_t HAL_EEPROM_Ready(void) {
+  return (int32_t)(HAL_Host_Stats.Time - Host.EEPROMReadyTime) >= 0;
+}
+
+uint8_t HAL_EEPROM_ReadByte(uint16_t Address) {
+  return Host.EEPROM[Address % HAL_HOST_EEPROM_SIZE];
+}
+
+// Starts the write and returns, the EEPROM is busy for HAL_HOST_EEPROM_WRITE_TICKS
+void HAL_EEPROM_WriteByte(uint16_t Address, uint8_t Value) {
+  while (!HAL_EEPROM_Ready()) {
+    HAL_Host_Advance(1);
+  }
+  Host.EEPROM[Address % HAL_HOST_EEPROM_SIZE] = Value;
+  HAL_Host_Stats.EEPROMWrites++;
+  Host.EEPROMReadyTime = HAL_Host_Stats.Time + HAL_HOST_EEPROM_WRITE_TICKS;
+}
+
+// tv_nsec alone wraps at 10^9, so the whole time is truncated
+HAL_Bench_t HAL_BenchTicks(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (HAL_Bench_t)((uint64_t)Now.tv_sec * 1000000000ULL + (uint64_t)Now.tv_nsec);
+}
+
+#endif // HAL_HOST
@@ -0,0 +1,172 @@
+/*
+ * HAL_Host.h
+ */
+
+#ifndef _HAL_HOST_H
+#define _HAL_HOST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Virtual ATmega328P for a Linux build, time only moves with HAL_Host_Advance
+// Build: gcc -DHAL_HOST -c *.c && g++ -DHAL_HOST -c *.cpp && g++ -o DimmerHost *.o
+
+#define F_CPU 16000000UL
+
+#define PROGMEM
+#define pgm_read_byte_near(a)  (*(const uint8_t *)(a))
+#define pgm_read_word_near(a)  (*(const uint16_t *)(a))
+#define pgm_read_dword_near(a) (*(const uint32_t *)(a))
+#define memcpy_P(d, s, n)      memcpy(d, s, n)
+#define PSTR(s)                (s)
+
+#define ISR(vector) void vector(void)
+#define cli()
+#define sei()
+
+// Timer1
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t ICR1;
+extern volatile uint8_t  TCCR1A;
+extern volatile uint8_t  TCCR1B;
+extern volatile uint8_t  TCCR1C;
+extern volatile uint8_t  TIMSK1;
+extern volatile uint8_t  TIFR1;
+extern volatile uint8_t  TIMSK0;
+// GPIO
+extern volatile uint8_t  DDRB;
+extern volatile uint8_t  PORTB;
+extern volatile uint8_t  DDRD;
+extern volatile uint8_t  PORTD;
+// USART configuration
+extern volatile uint8_t  UCSR0A;
+extern volatile uint8_t  UCSR0B;
+extern volatile uint8_t  UCSR0C;
+extern volatile uint16_t UBRR0;
+
+#define COM1A1  7
+#define COM1A0  6
+#define COM1B1  5
+#define COM1B0  4
+#define ICNC1   7
+#define ICES1   6
+#define CS11    1
+#define FOC1A   7
+#define FOC1B   6
+#define ICIE1   5
+#define OCIE1B  2
+#define OCIE1A  1
+#define ICF1    5
+#define OCF1B   2
+#define OCF1A   1
+
+#define DDB0    0
+#define DDB1    1
+#define DDB2    2
+#define DDB3    3
+#define DDB4    4
+#define DDB5    5
+#define PORTB0  0
+#define PORTB1  1
+#define PORTB2  2
+#define PORTB3  3
+#define PORTB4  4
+#define PORTB5  5
+#define DDD2    2
+#define DDD3    3
+#define DDD4    4
+#define DDD5    5
+#define DDD6    6
+#define DDD7    7
+#define PORTD2  2
+#define PORTD3  3
+#define PORTD4  4
+#define PORTD5  5
+#define PORTD6  6
+#define PORTD7  7
+
+#define RXC0    7
+#define UDRE0   5
+#define DOR0    3
+#define U2X0    1
+#define RXEN0   4
+#define TXEN0   3
+#define UCSZ01  2
+#define UCSZ00  1
+
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+
+uint8_t HAL_USART_RxReady(void);
+uint8_t HAL_USART_RxData(void);
+uint8_t HAL_USART_TxReady(void);
+void HAL_USART_TxData(uint8_t Value);
+
+void HAL_EEPROM_Get(uint16_t Address, void *pData, uint16_t Size);
+void HAL_EEPROM_Put(uint16_t Address, const void *pData, uint16_t Size);
+uint8_t HAL_EEPROM_Ready(void);
+uint8_t HAL_EEPROM_ReadByte(uint16_t Address);
+void HAL_EEPROM_WriteByte(uint16_t Address, uint8_t Value);
+
+// Host nanoseconds (truncated to 32 bit, 4.3 S), for benchmarks
+typedef uint32_t HAL_Bench_t;
+HAL_Bench_t HAL_BenchTicks(void);
+// No CPU cycles on the host, the nanoseconds of the host CPU do not represent the ATmega328P (only compare within a run)
+#define HAL_BenchCycles(Ticks)        ((uint32_t)(Ticks))
+#define HAL_BENCH_UNIT                "host nanoseconds, not ATmega328P cycles"
+// Range of HAL_BenchTicks, free running 32 bit
+#define HAL_BenchPeriod(HalfPeriod)   0
+
+// Simulation
+
+#define HAL_HOST_EEPROM_SIZE        1024
+#define HAL_HOST_EEPROM_WRITE_TICKS 6600 // 3.3 mS per byte
+#define HAL_HOST_BAUD_TICKS         2083 // 10 bits at 9600 baud
+#define HAL_HOST_GATES              8    // Gate outputs D9 (OC1A), D10 (OC1B), D2..D7
+// Irq timing of the ATmega328P, estimated from the generated code (1 tick is 8 CPU cycles), 0 runs an Irq at its event
+// A compare Irq starts at the compare match, or when the running Irq ends, its port writes are ENTRY ticks later
+// The hardware compare outputs (OC1A, OC1B) switch at the match
+#define HAL_HOST_IRQ_ENTRY_TICKS    5    // Response, vector and prologue, about 40 cycles
+#define HAL_HOST_COMPARE_TICKS      14   // Compare Irq, about 110 cycles
+#define HAL_HOST_CAPTURE_TICKS      25   // Capture Irq, about 200 cycles
+
+typedef struct {
+  uint32_t Time;          // Ticks since start
+  uint32_t Captures;      // Zero crossings
+  uint32_t Glitches;      // Noise edges on ICP1, HAL_Host_Glitch
+  uint32_t CaptureNsMax;  // Host time of the capture Irq of a zero crossing
+  uint64_t CaptureNsSum;
+  uint32_t GlitchNsMax;   // Host time of the capture Irq of a noise edge
+  uint64_t GlitchNsSum;
+  uint32_t RxOverrun;     // Received characters lost because the previous one was not read in time
+  uint32_t EEPROMWrites;
+  uint32_t GatePulses[HAL_HOST_GATES];
+  uint16_t GateOn[HAL_HOST_GATES]; // TCNT1 of the last rising gate edge, ticks after the timer reset
+  uint16_t GateOnZero[HAL_HOST_GATES]; // Last rising gate edge, ticks after the zero crossing of the mains
+  uint32_t GateFirst[HAL_HOST_GATES]; // Half cycle (Captures) of the first and the last gate pulse
+  uint32_t GateLast[HAL_HOST_GATES];
+} HAL_Host_Stats_t;
+
+extern HAL_Host_Stats_t HAL_Host_Stats;
+
+void HAL_Host_Initialize(uint16_t HalfPeriod);
+void HAL_Host_SetHalfPeriod(uint16_t HalfPeriod);
+void HAL_Host_SetDetector(uint16_t EdgeJitter, uint16_t IrqLatency);
+void HAL_Host_Glitch(uint32_t Delay);
+void HAL_Host_Advance(uint32_t Ticks);
+void HAL_Host_RxInject(uint8_t Value);
+void HAL_Host_SetTxOutput(void (*pOutput)(uint8_t Value));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HAL_HOST_H */
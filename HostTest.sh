@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# HostTest.sh
+#
+# Checks of the dimmer on the host simulator (HAL_Host.c, DimmerHost.cpp), exit code 1 when a check fails
+# Every configuration is built from a copy of the sources with the debug output off
+# Usage: sh HostTest.sh
+
+Source=$(cd "$(dirname "$0")" && pwd)
+Work=$(mktemp -d)
+Failed=0
+trap 'rm -rf "$Work"' EXIT
+
+# Build <Name> [sed script for Dimmer_Config.h]
+Build() {
+  mkdir "$Work/$1" && cp "$Source"/*.c "$Source"/*.cpp "$Source"/*.h "$Source"/*.ino "$Work/$1" || exit 1
+  sed -i 's|^#define DEBUG_DIMMER$|//#define DEBUG_DIMMER|' "$Work/$1/Dimmer_Config.h"
+  sed -i 's|^#define DEBUG_COMMAND$|//#define DEBUG_COMMAND|' "$Work/$1/Command_CFG.h"
+  [ -n "$2" ] && sed -i "$2" "$Work/$1/Dimmer_Config.h"
+  (cd "$Work/$1" && gcc -DHAL_HOST -c *.c && g++ -DHAL_HOST -c *.cpp && g++ -o DimmerHost *.o -lm) > "$Work/$1.log" 2>&1 || { echo "FAIL build $1"; cat "$Work/$1.log"; exit 1; }
+}
+
+# Run <Name> <Serial input> <DimmerHost arguments..>, the statistics are in $Stats, the output in $Output
+Run() {
+  Name=$1
+  Input=$2
+  shift 2
+  printf "$Input" | "$Work/$Name/DimmerHost" "$@" > "$Work/out" 2> "$Work/err"
+  Stats=$(cat "$Work/err")
+  Output=$(cat "$Work/out")
+}
+
+# Check <Description> <Result> <Expected>
+Check() {
+  if [ "$2" = "$3" ]; then
+    echo "PASS $1"
+  else
+    echo "FAIL $1: $2, expected $3"
+    Failed=1
+  fi
+}
+
+# Gate <Number>: pulses, first and last half cycle of the pulses ("0 0 0" without pulses)
+Gate() {
+  echo "$Stats" | sed -n "s/^Gate $1: pulses \([0-9]*\) (half cycle \([0-9]*\)\.\.\([0-9]*\)).*/\1 \2 \3/p" | grep . || echo "0 0 0"
+}
+
+# A fade to Dali 0 switches the gate off, also with predictive firing (a compare value is never below DIMMER_PREDICT_MIN_OCR)
+Build Predictive 's|^//#define DIMMER_PREDICTIVE_FIRING|#define DIMMER_PREDICTIVE_FIRING|'
+Run Predictive '#0010C8\n#0011000064\n' 4000 50
+set -- $(Gate 0)
+Check "predictive fade to 0, no pulse after the fade" "$([ "$3" -lt 100 ] && echo off || echo "last pulse in half cycle $3")" off
+
+# A command queued for a cycle (address 0x13) fires on that cycle, also after the lookahead ring ran empty
+# 100000 tick loop passes (5 half periods, longer than DIMMER_LOOKAHEAD) cause underruns
+Build Default
+Run Default '#13000003E80010C8\n' 1500 50 6
+set -- $(Gate 0)
+First=$2
+Run Default '#13000003E80010C8\n' 1500 50 6 0 0 0 0 0 100000
+set -- $(Gate 0)
+Check "queued command on its cycle after underruns" "$2" "$First"
+Check "underruns in the stalled run" "$(echo "$Stats" | sed -n 's/^Missed cycles \([0-9]*\)/\1/p' | grep -v '^0$' | sed 's/.*/yes/')" yes
+
+# Every reply of a pipelined burst of read commands is complete, Command_Scheduler waits for room in the protocol lane
+Run Default "$(printf '#00F5\\n%.0s' $(seq 20))" 500 50
+Check "pipelined reads, complete replies" "$(echo "$Output" | tr -d '\006' | grep -c '#[0-9A-F]\{8\}$')" 20
+Check "pipelined reads, dropped protocol bytes" "$(echo "$Stats" | sed -n 's/.*dropped protocol \([0-9]*\).*/\1/p')" 0
+
+exit $Failed
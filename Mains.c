@@ -0,0 +1,82 @@
+/*
+ * Mains.c
+ */
+
+#include "HAL.h"
+#include "Mains.h"
+
+typedef struct {
+  uint32_t HalfPeriod; // Filtered, 16.8 fixed point
+  uint8_t  Count;      // Half periods without a miss
+  uint8_t  Misses;     // Misses in a row
+  uint8_t  Locked;
+  uint16_t Unlocks;
+} Mains_t;
+
+static Mains_t Mains;
+
+void Mains_Initialize(void) {
+  Mains.HalfPeriod = 0;
+  Mains.Count = 0;
+  Mains.Misses = MAINS_UNLOCK_COUNT - 1; // The first half period starts the filter
+  Mains.Locked = 0;
+  Mains.Unlocks = 0;
+}
+
+// Called with the last captured half period, once per Dimmer cycle
+// A disturbed half period (miss) is not filtered, a drifting grid is followed
+void Mains_Update(uint16_t HalfPeriod) {
+  uint32_t Period = (uint32_t)HalfPeriod << 8;
+  uint16_t Filtered = (uint16_t)(Mains.HalfPeriod >> 8);
+  uint16_t Difference;
+
+  Difference = (HalfPeriod > Filtered) ? (HalfPeriod - Filtered) : (Filtered - HalfPeriod);
+  if ((HalfPeriod < MAINS_HALF_PERIOD_MIN) || (HalfPeriod > MAINS_HALF_PERIOD_MAX) || (Difference > MAINS_TOLERANCE)) {
+    Mains.Misses++;
+    if (Mains.Misses >= MAINS_UNLOCK_COUNT) {
+      if (Mains.Locked) {
+        Mains.Unlocks++;
+      }
+      Mains.Locked = 0;
+      Mains.Count = 0;
+      Mains.Misses = 0;
+      Mains.HalfPeriod = Period;
+    }
+    return;
+  }
+  Mains.Misses = 0;
+  if (Period > Mains.HalfPeriod) {
+    Mains.HalfPeriod += (Period - Mains.HalfPeriod) >> MAINS_FILTER_SHIFT;
+  } else {
+    Mains.HalfPeriod -= (Mains.HalfPeriod - Period) >> MAINS_FILTER_SHIFT;
+  }
+  if (Mains.Count < MAINS_LOCK_COUNT) {
+    Mains.Count++;
+  } else {
+    Mains.Locked = 1;
+  }
+}
+
+uint8_t Mains_Locked(void) {
+  return Mains.Locked;
+}
+
+// Filtered half period in Timer1 ticks, 0 without lock
+uint16_t Mains_GetHalfPeriod(void) {
+  if (Mains.Locked == 0) {
+    return 0;
+  }
+  return (uint16_t)((Mains.HalfPeriod + 128) >> 8);
+}
+
+// 50 or 60, 0 without lock
+uint8_t Mains_GetHz(void) {
+  if (Mains.Locked == 0) {
+    return 0;
+  }
+  return ((Mains.HalfPeriod >> 8) < MAINS_HALF_PERIOD_60HZ) ? 60 : 50;
+}
+
+uint16_t Mains_GetUnlocks(void) {
+  return Mains.Unlocks;
+}
@@ -0,0 +1,34 @@
+/*
+ * Mains.h
+ */
+
+#ifndef _MAINS_H
+#define _MAINS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Tracking of the mains half period (zero crossing to zero crossing) in Timer1 ticks (0.5 uS)
+#define MAINS_HALF_PERIOD_MIN    15000 // 66 Hz, shorter periods are not mains
+#define MAINS_HALF_PERIOD_MAX    22500 // 44 Hz
+#define MAINS_HALF_PERIOD_60HZ   18333 // 55 Hz, border between 50 and 60 Hz
+#define MAINS_FILTER_SHIFT       3     // IIR filter, 1/8 of the difference per half period
+#define MAINS_TOLERANCE          200   // 1%, a half period further from the filtered one is a miss
+#define MAINS_LOCK_COUNT         16    // Half periods without a miss for a lock
+#define MAINS_UNLOCK_COUNT       4     // Misses in a row that lose the lock and restart the filter
+
+void Mains_Initialize(void);
+void Mains_Update(uint16_t HalfPeriod);
+uint8_t Mains_Locked(void);
+uint16_t Mains_GetHalfPeriod(void);
+uint8_t Mains_GetHz(void);
+uint16_t Mains_GetUnlocks(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MAINS_H
@@ -0,0 +1,78 @@
+/*
+ * Monitor.c
+ */
+
+#include "HAL.h"
+#include "Monitor.h"
+#include "Dimmer.h"
+
+#define MONITOR_AVERAGE_SHIFT 4 // Moving average over about 16 runs
+
+typedef struct {
+  HAL_Bench_t Max;
+  uint32_t Sum; // Average << MONITOR_AVERAGE_SHIFT
+} Monitor_Scheduler_t;
+
+typedef struct {
+  Monitor_Scheduler_t Scheduler[MonitorMAX];
+  uint32_t MissedCycles;
+  uint32_t RejectedCaptures; // Zero crossing edges rejected as glitch
+} Monitor_t;
+
+static Monitor_t Monitor;
+
+void Monitor_Initialize(void) {
+  Monitor_Reset();
+}
+
+void Monitor_Reset(void) {
+  for (uint8_t i = 0; i < MonitorMAX; i++) {
+    Monitor.Scheduler[i].Max = 0;
+    Monitor.Scheduler[i].Sum = 0;
+  }
+  Monitor.MissedCycles = 0;
+  Monitor.RejectedCaptures = 0;
+}
+
+// Start is the HAL_BenchTicks before the scheduler ran, returns the current HAL_BenchTicks as start for the next scheduler
+HAL_Bench_t Monitor_Measure(Monitor_Select_t Select, HAL_Bench_t Start) {
+  HAL_Bench_t Now;
+  HAL_Bench_t Ticks;
+
+  Now = HAL_BenchTicks();
+  Ticks = Now - Start;
+  if (Now < Start) {
+    // Timer1 is reset at the zero crossing
+    Ticks += HAL_BenchPeriod(Dimmer_GetPulsePeriod());
+  }
+  if (Ticks > Monitor.Scheduler[Select].Max) {
+    Monitor.Scheduler[Select].Max = Ticks;
+  }
+  Monitor.Scheduler[Select].Sum += Ticks - (Monitor.Scheduler[Select].Sum >> MONITOR_AVERAGE_SHIFT);
+  return Now;
+}
+
+// Called by Dimmer_Scheduler with the lookahead ring underruns, zero crossings that found no new firing value (the previous one is used again)
+void Monitor_MissedCycles(uint8_t Count) {
+  Monitor.MissedCycles += Count;
+}
+
+void Monitor_RejectedCaptures(uint8_t Count) {
+  Monitor.RejectedCaptures += Count;
+}
+
+HAL_Bench_t Monitor_GetMax(Monitor_Select_t Select) {
+  return Monitor.Scheduler[Select].Max;
+}
+
+uint16_t Monitor_GetAverage(Monitor_Select_t Select) {
+  return (uint16_t)(Monitor.Scheduler[Select].Sum >> MONITOR_AVERAGE_SHIFT);
+}
+
+uint32_t Monitor_GetMissedCycles(void) {
+  return Monitor.MissedCycles;
+}
+
+uint32_t Monitor_GetRejectedCaptures(void) {
+  return Monitor.RejectedCaptures;
+}
@@ -0,0 +1,37 @@
+/*
+ * Monitor.h
+ */
+
+#ifndef _MONITOR_H
+#define _MONITOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "HAL.h"
+
+// Run time of the schedulers in loop(), in HAL_BenchTicks (Timer1 ticks of 0.5 uS)
+typedef enum {
+  MonitorDimmer = 0,
+  MonitorUSARTP = 1,
+  MonitorCommand = 2,
+  MonitorMAX,
+} Monitor_Select_t;
+
+void Monitor_Initialize(void);
+void Monitor_Reset(void);
+HAL_Bench_t Monitor_Measure(Monitor_Select_t Select, HAL_Bench_t Start);
+void Monitor_MissedCycles(uint8_t Count);
+void Monitor_RejectedCaptures(uint8_t Count);
+HAL_Bench_t Monitor_GetMax(Monitor_Select_t Select);
+uint16_t Monitor_GetAverage(Monitor_Select_t Select);
+uint32_t Monitor_GetMissedCycles(void);
+uint32_t Monitor_GetRejectedCaptures(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MONITOR_H
@@ -2,12 +2,12 @@
  * Settings.c
  */
 
-#include "Arduino.h"
+#include "HAL.h"
 #include "Settings.h"
 #include "Dimmer_Config.h"
 #include "Tool.h"
 #include "TinyPrintf.h"
-#include <EEPROM.h>
+#include <stddef.h>
 
 #if defined(DEBUG_SETTINGS)
 #define debug_tiny_printf(...) tiny_printf(__VA_ARGS__)
@@ -19,26 +19,156 @@
 
 Settings_t Settings;
 
+// Journal of Settings records rotating over the EEPROM, every save writes the next slot
+// The valid record (CRC) with the highest sequence number is the current one, a torn write
+// leaves an invalid record and the previous record stays current
+// The Sequence is written last (SET_Offset), a torn record keeps the old sequence of its slot, the oldest one,
+// so it can never be the current record, even when its mixed data passes the CRC
+typedef struct {
+  uint16_t Sequence;  // 0xFFFF is an erased slot
+  Settings_t Settings;
+  uint8_t CRC;        // CRC8 of Sequence and Settings
+} SET_Record_t;
+
+#define SET_SLOTS (SETTINGS_EEPROM_SIZE / sizeof(SET_Record_t))
+
+// Settings of DIMMER_VERSION 0, without journal and with one calibration for all channels
+typedef struct {
+  uint8_t Version;
+  uint8_t MainzHZ;
+  uint16_t RangeMin;
+  uint16_t RangeMax;
+} SET_Legacy_t;
+
+// Write-behind of SET_Save, the EEPROM is written one byte per SET_Scheduler call
+typedef struct {
+  uint8_t Slot;        // Slot of the current record, SET_SLOTS when there is none
+  uint16_t Sequence;   // Of the current record
+  SET_Record_t Image;  // Record being written to Slot
+  uint8_t Index;       // Next byte of Image in write order (SET_Offset), sizeof(SET_Record_t) when all bytes are written
+  uint8_t Written;     // Changed bytes written
+} SET_Journal_t;
+
+static SET_Journal_t SET_Journal;
+
 void SET_Validate(void);
+static void SET_Scan(void);
+static uint8_t SET_RecordCRC(const SET_Record_t *pRecord);
+static inline uint8_t SET_Offset(uint8_t Index);
 
 void SET_Initialize(void) {
   debug_tiny_printf("Begin init Settings\n"); 
+  SET_Journal.Index = sizeof(SET_Record_t);
+  SET_Scan();
   SET_Load();
   debug_tiny_printf("End init Settings\n");
 }
 
+static uint8_t SET_RecordCRC(const SET_Record_t *pRecord) {
+  const uint8_t *pData = (const uint8_t *)pRecord;
+  uint8_t Crc = 0;
+  uint8_t i;
+  for (i = 0; i < offsetof(SET_Record_t, CRC); i++) {
+    Crc = CRC8_Update(Crc, pData[i]);
+  }
+  return Crc;
+}
+
+// One pass over all slots for the newest valid record
+static void SET_Scan(void) {
+  SET_Record_t Record;
+  uint8_t Slot;
+
+  SET_Journal.Slot = SET_SLOTS;
+  for (Slot = 0; Slot < SET_SLOTS; Slot++) {
+    HAL_EEPROM_Get(SETTINGS_EEPROM_ADDR + Slot * sizeof(SET_Record_t), &Record, sizeof(SET_Record_t));
+    if ((Record.Sequence == 0xFFFF) || (Record.CRC != SET_RecordCRC(&Record))) {
+      continue;
+    }
+    // Newer with wrap around, at most SET_SLOTS sequence numbers are in use
+    if ((SET_Journal.Slot == SET_SLOTS) || ((int16_t)(Record.Sequence - SET_Journal.Sequence) > 0)) {
+      SET_Journal.Slot = Slot;
+      SET_Journal.Sequence = Record.Sequence;
+    }
+  }
+  debug_tiny_printf("Settings record %u of %u, sequence %u\n", SET_Journal.Slot, SET_SLOTS, SET_Journal.Sequence);
+}
+
 uint8_t SET_Load(void) {
-  EEPROM.get(SETTINGS_EEPROM_ADDR, Settings);
+  SET_Record_t Record;
+  SET_Legacy_t Legacy;
+
+  if (SET_Journal.Index < sizeof(SET_Record_t)) {
+    Settings = SET_Journal.Image.Settings; // Not completely in the EEPROM yet
+  } else if (SET_Journal.Slot < SET_SLOTS) {
+    HAL_EEPROM_Get(SETTINGS_EEPROM_ADDR + SET_Journal.Slot * sizeof(SET_Record_t), &Record, sizeof(SET_Record_t));
+    Settings = Record.Settings;
+  } else {
+    // No record yet, Settings of a version without journal (or an erased EEPROM)
+    HAL_EEPROM_Get(SETTINGS_EEPROM_LEGACY_ADDR, &Legacy, sizeof(Legacy));
+    Settings.Version = (Legacy.Version == 0) ? DIMMER_VERSION : 0xFF;
+    Settings.MainzHZ = Legacy.MainzHZ;
+    for (uint8_t i = 0; i < SETTINGS_CHANNELS; i++) {
+      Settings.RangeMin[i] = Legacy.RangeMin;
+      Settings.RangeMax[i] = Legacy.RangeMax;
+    }
+  }
   SET_ShowSettings();
   SET_Validate();
   SET_ShowSettings();
   return 1;
 }
 
+// Returns at once, SET_Scheduler writes the record, see SET_SaveBusy
+// A save during a save continues with the new Settings in the next slot
 void SET_Save(void) {
   Settings.Version = DIMMER_VERSION;
-  SET_ShowSettings();
-  EEPROM.put(SETTINGS_EEPROM_ADDR, Settings);
+  debug_tiny_printf("Saving settings\n");
+  if (SET_Journal.Slot < SET_SLOTS - 1) {
+    SET_Journal.Slot++;
+  } else {
+    SET_Journal.Slot = 0;
+  }
+  SET_Journal.Sequence++;
+  if (SET_Journal.Sequence == 0xFFFF) {
+    SET_Journal.Sequence = 0;
+  }
+  SET_Journal.Image.Sequence = SET_Journal.Sequence;
+  SET_Journal.Image.Settings = Settings;
+  SET_Journal.Image.CRC = SET_RecordCRC(&SET_Journal.Image);
+  SET_Journal.Index = 0;
+  SET_Journal.Written = 0;
+}
+
+// Byte of the record written as Index-th, Settings and CRC first, Sequence last
+static inline uint8_t SET_Offset(uint8_t Index) {
+  return (Index + sizeof(SET_Journal.Image.Sequence)) % sizeof(SET_Record_t);
+}
+
+// At most one EEPROM byte is written per call and only when the EEPROM is ready, never waits
+void SET_Scheduler(void) {
+  const uint8_t *pImage = (const uint8_t *)&SET_Journal.Image;
+  uint16_t Address = SETTINGS_EEPROM_ADDR + SET_Journal.Slot * sizeof(SET_Record_t);
+
+  if ((SET_Journal.Index >= sizeof(SET_Record_t)) || !HAL_EEPROM_Ready()) {
+    return;
+  }
+  while ((SET_Journal.Index < sizeof(SET_Record_t)) && (HAL_EEPROM_ReadByte(Address + SET_Offset(SET_Journal.Index)) == pImage[SET_Offset(SET_Journal.Index)])) {
+    SET_Journal.Index++;
+  }
+  if (SET_Journal.Index < sizeof(SET_Record_t)) {
+    HAL_EEPROM_WriteByte(Address + SET_Offset(SET_Journal.Index), pImage[SET_Offset(SET_Journal.Index)]);
+    SET_Journal.Index++;
+    SET_Journal.Written++;
+  }
+  if (SET_Journal.Index >= sizeof(SET_Record_t)) {
+    debug_tiny_printf("Settings saved in record %u, %u bytes written\n", SET_Journal.Slot, SET_Journal.Written);
+  }
+}
+
+// 1 until the last byte of SET_Save is written
+uint8_t SET_SaveBusy(void) {
+  return (SET_Journal.Index < sizeof(SET_Record_t)) || !HAL_EEPROM_Ready();
 }
  
 void SET_LoadScratch(void) {
@@ -46,34 +176,41 @@ void SET_LoadScratch(void) {
   Settings.Version = DIMMER_VERSION;
   Settings.MainzHZ = 50;
   // In range of SET_DIM_RANGE_MIN_50HZ and SET_DIM_RANGE_MAX_50HZ
-  Settings.RangeMin =  2000; // range = 0 to 20000
-  Settings.RangeMax = 18000; // range = 0 to 20000
+  for (uint8_t i = 0; i < SETTINGS_CHANNELS; i++) {
+    Settings.RangeMin[i] =  2000; // range = 0 to 20000
+    Settings.RangeMax[i] = 18000; // range = 0 to 20000
+  }
 }
 
 void SET_Validate(void) {
   debug_tiny_printf("Validating settings\n");
   
   
-  if (Settings.Version == 0xFF) { // first time erased flash
+  if (Settings.Version != DIMMER_VERSION) { // first time erased flash or unknown layout
     SET_LoadScratch();
     return;
   }
 
-  if (Settings.MainzHZ == 50) {
-    CLIPtoMin(Settings.RangeMin, SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
-    CLIP(Settings.RangeMax, SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
-  } else if (Settings.MainzHZ == 60) {
-    CLIPtoMin(Settings.RangeMin, SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
-    CLIP(Settings.RangeMax, SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
-  } else {  // first time erased flash
-    SET_LoadScratch();
+  for (uint8_t i = 0; i < SETTINGS_CHANNELS; i++) {
+    if (Settings.MainzHZ == 50) {
+      CLIPtoMin(Settings.RangeMin[i], SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
+      CLIP(Settings.RangeMax[i], SET_DIM_RANGE_MIN_50HZ, SET_DIM_RANGE_MAX_50HZ);
+    } else if (Settings.MainzHZ == 60) {
+      CLIPtoMin(Settings.RangeMin[i], SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
+      CLIP(Settings.RangeMax[i], SET_DIM_RANGE_MIN_60HZ, SET_DIM_RANGE_MAX_60HZ);
+    } else {  // first time erased flash
+      SET_LoadScratch();
+      return;
+    }
   }
 }
 
 void SET_ShowSettings(void) {
   debug_tiny_printf("0x%02x %u\n", Settings.Version, Settings.Version);
   debug_tiny_printf("0x%02x %u\n", Settings.MainzHZ, Settings.MainzHZ);
-  debug_tiny_printf("0x%04x %u\n", Settings.RangeMin, Settings.RangeMin);
-  debug_tiny_printf("0x%04x %u\n", Settings.RangeMax, Settings.RangeMax);
+  for (uint8_t i = 0; i < SETTINGS_CHANNELS; i++) {
+    debug_tiny_printf("%u 0x%04x %u\n", i, Settings.RangeMin[i], Settings.RangeMin[i]);
+    debug_tiny_printf("%u 0x%04x %u\n", i, Settings.RangeMax[i], Settings.RangeMax[i]);
+  }
   debug_flush_printf();
 }
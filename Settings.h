@@ -21,8 +21,8 @@ extern "C" {
 typedef struct {
   uint8_t Version;
   uint8_t MainzHZ;
-  uint16_t RangeMin;
-  uint16_t RangeMax;
+  uint16_t RangeMin[SETTINGS_CHANNELS]; // Calibration of every dimmer channel
+  uint16_t RangeMax[SETTINGS_CHANNELS];
 } Settings_t;
 
 extern Settings_t Settings;
@@ -32,6 +32,8 @@ void SET_Initialize(void);
 uint8_t SET_Load(void);
 void SET_Save(void); 
 void SET_LoadScratch(void);
+void SET_Scheduler(void);
+uint8_t SET_SaveBusy(void);
 
 void SET_ShowSettings(void);
 
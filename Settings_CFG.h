@@ -7,6 +7,12 @@
 
 #define DEBUG_SETTINGS
 
-#define SETTINGS_EEPROM_ADDR  32
+#define SETTINGS_CHANNELS  2 // Calibrations, DIMMER_CHANNELS at least
+
+// Journal of Settings records, rotating over the whole EEPROM (wear leveling)
+#define SETTINGS_EEPROM_ADDR  0
+#define SETTINGS_EEPROM_SIZE  1024
+// Settings of versions without journal, only read when there is no journal record
+#define SETTINGS_EEPROM_LEGACY_ADDR  32
 
 #endif // SETTINGS_CFG_H_
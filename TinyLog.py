@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# TinyLog.py
+#
+# Decoder of the serial output with tokenized tiny_printf records (TINY_PRINTF_TOKENIZED, TinyPrintf_CFG.h)
+# The string table (token -> format) is generated from the tiny_printf formats in the sources
+#
+# Usage: TinyLog.py [--table] [Capture]
+#  --table  Print the string table and stop
+#  Capture  File with the received bytes, default stdin
+# Example: ./DimmerHost 500 50 < Commands | python3 TinyLog.py
+#
+
+import glob
+import os
+import re
+import sys
+
+RECORD_SOF = 0xB0  # USARTP_DEBUG_RECORD_SOF, USARTP.h
+ACK = 0x06
+NAK = 0x15
+
+FORMAT_CALL = re.compile(r'tiny_printf\s*\(\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+CONVERSION = re.compile(r'%(%|[-0]*\d*l?[diuxXcs])')
+
+
+# Same as tiny_token in TinyPrintf.h
+def token(Format):
+  Hash = 2166136261
+  for C in Format.encode('latin-1'):
+    Hash = ((Hash ^ C) * 16777619) & 0xFFFFFFFF
+  return (Hash ^ (Hash >> 16)) & 0xFFFF
+
+
+def string_table(Directory):
+  Table = {}
+  for Name in sorted(glob.glob(os.path.join(Directory, '*.cpp')) + glob.glob(os.path.join(Directory, '*.ino'))):
+    with open(Name, encoding='latin-1') as File:
+      Source = File.read()
+    for Call in FORMAT_CALL.finditer(Source):
+      Format = ''.join(LITERAL.findall(Call.group(1)))
+      Format = Format.encode('latin-1').decode('unicode_escape')
+      Token = token(Format)
+      if Token in Table and Table[Token] != Format:
+        sys.stderr.write('TinyLog: token 0x%04X of "%s" and "%s", change one of the formats\n' % (Token, Table[Token], Format))
+      Table[Token] = Format
+  return Table
+
+
+def read_number(Data, i):
+  Value = 0
+  Shift = 0
+  while i < len(Data):
+    Value |= (Data[i] & 0x7F) << Shift
+    Shift += 7
+    i += 1
+    if (Data[i - 1] & 0x80) == 0:
+      return Value, i
+  return None, i
+
+
+def read_string(Data, i):
+  End = Data.find(b'\0', i)
+  if End < 0:
+    return None, len(Data)
+  return Data[i:End].decode('latin-1'), End + 1
+
+
+def format_record(Table, Data):
+  if len(Data) < 2:
+    return '<record ?>'
+  Token = Data[0] | (Data[1] << 8)
+  if Token not in Table:
+    return '<token 0x%04X %s>\n' % (Token, Data[2:].hex())
+  Format = Table[Token]
+  Text = ''
+  i = 2
+  Last = 0
+  for Match in CONVERSION.finditer(Format):
+    Text += Format[Last:Match.start()]
+    Last = Match.end()
+    Spec = Match.group(1)
+    if Spec == '%':
+      Text += '%'
+      continue
+    Spec = Spec.replace('l', '')
+    if Spec[-1] == 's':
+      Value, i = read_string(Data, i)
+    else:
+      Value, i = read_number(Data, i)
+      if Value is not None and Spec[-1] in 'di' and Value >= 0x80000000:
+        Value -= 0x100000000
+      Spec = Spec.replace('u', 'd').replace('x', 'X')  # tiny_put_number prints hex in uppercase
+    Text += '?' if Value is None else ('%' + Spec) % Value
+  return Text + Format[Last:]
+
+
+def decode(Table, Data, Output):
+  i = 0
+  while i < len(Data):
+    C = Data[i]
+    if C == RECORD_SOF and i + 1 < len(Data):
+      Size = Data[i + 1]
+      Output.write(format_record(Table, Data[i + 2:i + 2 + Size]))
+      i += 2 + Size
+    elif (C & 0xF0) == 0xA0:
+      # Binary protocol reply <0xA0|N><N data bytes><CRC8>
+      Size = (C & 0x0F) + 2
+      Output.write('<%s>' % Data[i:i + Size].hex(' ').upper())
+      i += Size
+    elif C == ACK:
+      Output.write('<ACK>')
+      i += 1
+    elif C == NAK:
+      Output.write('<NAK>')
+      i += 1
+    else:
+      Output.write(chr(C))
+      i += 1
+
+
+def main():
+  Arguments = sys.argv[1:]
+  Table = string_table(os.path.dirname(os.path.abspath(__file__)))
+  if '--table' in Arguments:
+    for Token in sorted(Table):
+      sys.stdout.write('0x%04X %s\n' % (Token, Table[Token].encode('unicode_escape').decode('latin-1')))
+    return
+  if Arguments:
+    with open(Arguments[0], 'rb') as File:
+      Data = File.read()
+  else:
+    Data = sys.stdin.buffer.read()
+  decode(Table, Data, sys.stdout)
+
+
+if __name__ == '__main__':
+  main()
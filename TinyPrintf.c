@@ -18,6 +18,7 @@
  * that is unacceptable in most embedded systems.
  */
 
+#include "HAL.h"
 #include "TinyPrintf.h"
 #include <stdint.h>
 #include <string.h>
@@ -34,6 +35,7 @@ typedef struct params_s {
   uint8_t do_padding;
   uint8_t left_flag;
   uint8_t unsigned_flag;
+  uint8_t long_flag;
 } params_t;
 
 static void padding(const uint8_t l_flag, const struct params_s *par);
@@ -175,6 +177,7 @@ void tiny_printf(const char *ctrl1, ...) {
     Check = 0;
     dot_flag = 0;
     par.unsigned_flag = 0;
+    par.long_flag = 0;
     par.left_flag = 0;
     par.do_padding = 0;
     par.pad_character = ' ';
@@ -223,24 +226,33 @@ void tiny_printf(const char *ctrl1, ...) {
       dot_flag = 1;
       Check = 0;
       break;
-    case 'l': // No long, max is uint32_t / int32_t
-     	TinyPrintf_CFG_putch('%'); // No long output supported with this architecture
-      TinyPrintf_CFG_putch('l');
+    case 'l': // Long, uint32_t / int32_t (int is 16 bit on the AtMega)
+      par.long_flag = 1;
       Check = 0;
       break;
-    case 'u': // Unsigned uint32_t
+    case 'u': // Unsigned
       par.unsigned_flag = 1;
       // Fall through
-    case 'i': // Integer int32_t
-    case 'd': // Decimal int32_t
-      out_number( va_arg(argp, int), 10L, &par);
+    case 'i': // Integer
+    case 'd': // Decimal
+      if (par.long_flag) {
+        out_number(va_arg(argp, int32_t), 10L, &par);
+      } else if (par.unsigned_flag) {
+        out_number(va_arg(argp, unsigned int), 10L, &par);
+      } else {
+        out_number(va_arg(argp, int), 10L, &par);
+      }
   		Check = 1;
       break;
     case 'p': // Pointer address
     case 'X': // Hexadecimal
     case 'x': // Hexadecimal
       par.unsigned_flag = 1;
-      out_number((int32_t)va_arg(argp, int), 16L, &par);
+      if (par.long_flag) {
+        out_number((int32_t)va_arg(argp, uint32_t), 16L, &par);
+      } else {
+        out_number((int32_t)va_arg(argp, unsigned int), 16L, &par);
+      }
       Check = 1;
       break;
     case 's': // String
@@ -287,3 +299,176 @@ void tiny_printf(const char *ctrl1, ...) {
   }
   va_end(argp);
 }
+
+// Division free number and string output, used by the C++ tiny_printf (see TinyPrintf.h)
+
+static const uint32_t tiny_decimal[] PROGMEM = { 1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10 };
+
+static void tiny_padding(uint8_t Width, uint8_t Length, char Pad) {
+  while (Width > Length) {
+    TinyPrintf_CFG_putch(Pad);
+    Width--;
+  }
+}
+
+// Writes the format (PROGMEM) up to the next conversion, which is parsed into pSpec
+// Returns the format after the conversion, or the end of the format
+const char *tiny_format_P(const char *pFormat, tiny_format_t *pSpec) {
+  char C;
+
+  while ((C = pgm_read_byte_near(pFormat)) != 0) {
+    pFormat++;
+    if (C != '%') {
+      TinyPrintf_CFG_putch(C);
+      continue;
+    }
+    C = pgm_read_byte_near(pFormat);
+    if (C == '%') {
+      TinyPrintf_CFG_putch('%');
+      pFormat++;
+      continue;
+    }
+    if (pSpec == NULL) {
+      break;
+    }
+    pSpec->Width = 0;
+    pSpec->Pad = ' ';
+    pSpec->Left = 0;
+    if (C == '-') {
+      pSpec->Left = 1;
+      C = pgm_read_byte_near(++pFormat);
+    }
+    if (C == '0') {
+      pSpec->Pad = '0';
+    }
+    while ((C >= '0') && (C <= '9')) {
+      pSpec->Width = pSpec->Width*10 + (C - '0');
+      C = pgm_read_byte_near(++pFormat);
+    }
+    while (C == 'l') {
+      // The size is taken from the argument
+      C = pgm_read_byte_near(++pFormat);
+    }
+    pSpec->Conversion = C;
+    if (C != 0) {
+      pFormat++;
+    }
+    break;
+  }
+  return pFormat;
+}
+
+// Value is the argument converted to uint32_t, Negative when the (signed) argument is negative
+void tiny_put_number(const tiny_format_t *pSpec, uint32_t Value, uint8_t Negative) {
+  uint8_t Length;
+  uint8_t Index;
+  uint32_t Power;
+  char Digit;
+
+  switch (pSpec->Conversion) {
+  case 'c':
+    TinyPrintf_CFG_putch((char)Value);
+    return;
+  case 'p':
+  case 'x':
+  case 'X':
+    // Nibbles from the highest, leading zero nibbles are skipped
+    Length = 8;
+    while ((Length > 1) && ((Value & 0xF0000000) == 0)) {
+      Value <<= 4;
+      Length--;
+    }
+    if (pSpec->Left == 0) {
+      tiny_padding(pSpec->Width, Length, pSpec->Pad);
+    }
+    for (Index = Length; Index != 0; Index--) {
+      Digit = (char)(Value >> 28);
+      TinyPrintf_CFG_putch(Digit < 10 ? '0' + Digit : 'A' - 10 + Digit);
+      Value <<= 4;
+    }
+    if (pSpec->Left) {
+      tiny_padding(pSpec->Width, Length, ' ');
+    }
+    return;
+  default:
+    break;
+  }
+
+  // Decimal, digits by subtracting powers of 10
+  if ((pSpec->Conversion == 'u') || (Negative == 0)) {
+    Negative = 0;
+  } else {
+    Value = 0 - Value;
+  }
+  Index = 0;
+  while ((Index < sizeof(tiny_decimal)/sizeof(tiny_decimal[0])) && (Value < pgm_read_dword_near(&tiny_decimal[Index]))) {
+    Index++;
+  }
+  Length = sizeof(tiny_decimal)/sizeof(tiny_decimal[0]) + 1 - Index + Negative;
+  if ((pSpec->Left == 0) && (pSpec->Pad == ' ')) {
+    tiny_padding(pSpec->Width, Length, ' ');
+  }
+  if (Negative) {
+    TinyPrintf_CFG_putch('-');
+  }
+  if ((pSpec->Left == 0) && (pSpec->Pad == '0')) {
+    tiny_padding(pSpec->Width, Length, '0');
+  }
+  for (; Index < sizeof(tiny_decimal)/sizeof(tiny_decimal[0]); Index++) {
+    Power = pgm_read_dword_near(&tiny_decimal[Index]);
+    Digit = '0';
+    while (Value >= Power) {
+      Value -= Power;
+      Digit++;
+    }
+    TinyPrintf_CFG_putch(Digit);
+  }
+  TinyPrintf_CFG_putch('0' + (char)Value);
+  if (pSpec->Left) {
+    tiny_padding(pSpec->Width, Length, ' ');
+  }
+}
+
+void tiny_put_string(const tiny_format_t *pSpec, const char *pString) {
+  uint8_t Length = 0;
+
+  if (pString == NULL) {
+    return;
+  }
+  if (pSpec->Width != 0) {
+    Length = (uint8_t)strlen(pString);
+  }
+  if (pSpec->Left == 0) {
+    tiny_padding(pSpec->Width, Length, ' ');
+  }
+  while (*pString != 0) {
+    TinyPrintf_CFG_putch(*pString++);
+  }
+  if (pSpec->Left) {
+    tiny_padding(pSpec->Width, Length, ' ');
+  }
+}
+
+// Tokenized arguments, an argument that does not fit is left out together with all following arguments
+void tiny_log_number(tiny_record_t *pRecord, uint32_t Value) {
+  if (pRecord->Size > TinyPrintf_CFG_RECORD_SIZE - 5) {
+    return;
+  }
+  while (Value > 0x7F) {
+    pRecord->Data[pRecord->Size++] = (uint8_t)Value | 0x80;
+    Value >>= 7;
+  }
+  pRecord->Data[pRecord->Size++] = (uint8_t)Value;
+}
+
+void tiny_log_string(tiny_record_t *pRecord, const char *pString) {
+  if (pRecord->Size > TinyPrintf_CFG_RECORD_SIZE - 5) {
+    return;
+  }
+  if (pString != NULL) {
+    while ((*pString != 0) && (pRecord->Size < TinyPrintf_CFG_RECORD_SIZE - 1)) {
+      pRecord->Data[pRecord->Size++] = (uint8_t)*pString++;
+    }
+  }
+  pRecord->Data[pRecord->Size++] = 0;
+}
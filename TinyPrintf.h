@@ -10,12 +10,125 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "HAL.h"
 #include "TinyPrintf_CFG.h"
 
+// Conversion of one argument, parsed from the format by tiny_format_P
+typedef struct {
+  uint8_t Width;
+  char    Pad;
+  uint8_t Left;
+  char    Conversion;
+} tiny_format_t;
+
 void tiny_printf(const char *ctrl1, ...);
+const char *tiny_format_P(const char *pFormat, tiny_format_t *pSpec);
+void tiny_put_number(const tiny_format_t *pSpec, uint32_t Value, uint8_t Negative);
+void tiny_put_string(const tiny_format_t *pSpec, const char *pString);
+
+// Tokenized record: token (little endian) and arguments
+typedef struct {
+  uint8_t Size;
+  uint8_t Data[TinyPrintf_CFG_RECORD_SIZE];
+} tiny_record_t;
+
+void tiny_log_number(tiny_record_t *pRecord, uint32_t Value);
+void tiny_log_string(tiny_record_t *pRecord, const char *pString);
 
 #ifdef __cplusplus
 }
+
+// C++: the format is stored in PROGMEM and every argument is formatted by its own type (8, 16 or 32 bit)
+// The number of arguments is checked against the format at compile time
+// (tiny_printf)(...) still calls the runtime C version above
+
+// Number of arguments of a format, %% is not an argument
+constexpr uint8_t tiny_format_args(const char *pFormat) {
+  return (*pFormat == 0) ? 0 :
+         (*pFormat != '%') ? tiny_format_args(pFormat + 1) :
+         (pFormat[1] == '%') ? tiny_format_args(pFormat + 2) :
+         (uint8_t)(1 + tiny_format_args(pFormat + 1));
+}
+
+template<typename T> void tiny_print_value(const tiny_format_t *pSpec, T Value) {
+  // Negative without a compare that is always false for unsigned types
+  tiny_put_number(pSpec, (uint32_t)Value, (Value < (T)1) && (Value != (T)0));
+}
+
+inline void tiny_print_value(const tiny_format_t *pSpec, const char *Value) {
+  tiny_put_string(pSpec, Value);
+}
+
+inline void tiny_print_value(const tiny_format_t *pSpec, char *Value) {
+  tiny_put_string(pSpec, Value);
+}
+
+inline void tiny_print_next(const char *pFormat) {
+  tiny_format_P(pFormat, NULL);
+}
+
+template<typename T, typename... Args> void tiny_print_next(const char *pFormat, T Value, Args... Rest) {
+  tiny_format_t Spec;
+  pFormat = tiny_format_P(pFormat, &Spec);
+  tiny_print_value(&Spec, Value);
+  tiny_print_next(pFormat, Rest...);
+}
+
+template<uint8_t Arguments, typename... Args> void tiny_print(const char *pFormat, Args... Rest) {
+  static_assert(Arguments == sizeof...(Args), "tiny_printf: the format does not match the arguments");
+  tiny_print_next(pFormat, Rest...);
+}
+
+// Tokenized (TINY_PRINTF_TOKENIZED): the format is not stored, one debug record is sent with
+// a 16 bit hash of the format (the token) and the arguments, TinyLog.py rebuilds the text from the sources
+//  Integer: 7 bits per byte, least significant first, bit 7 set when a byte follows (negative values as uint32_t)
+//  String: characters and a terminating 0
+
+// FNV-1a of the format, folded to 16 bits (same as TinyLog.py)
+constexpr uint32_t tiny_token_hash(const char *pFormat, uint32_t Hash) {
+  return (*pFormat == 0) ? Hash : tiny_token_hash(pFormat + 1, (Hash ^ (uint8_t)*pFormat) * 16777619UL);
+}
+
+constexpr uint16_t tiny_token(const char *pFormat) {
+  return (uint16_t)(tiny_token_hash(pFormat, 2166136261UL) ^ (tiny_token_hash(pFormat, 2166136261UL) >> 16));
+}
+
+template<typename T> void tiny_log_value(tiny_record_t *pRecord, T Value) {
+  tiny_log_number(pRecord, (uint32_t)Value);
+}
+
+inline void tiny_log_value(tiny_record_t *pRecord, const char *Value) {
+  tiny_log_string(pRecord, Value);
+}
+
+inline void tiny_log_value(tiny_record_t *pRecord, char *Value) {
+  tiny_log_string(pRecord, Value);
+}
+
+inline void tiny_log_next(tiny_record_t *pRecord) {
+  (void)pRecord;
+}
+
+template<typename T, typename... Args> void tiny_log_next(tiny_record_t *pRecord, T Value, Args... Rest) {
+  tiny_log_value(pRecord, Value);
+  tiny_log_next(pRecord, Rest...);
+}
+
+template<uint16_t Token, uint8_t Arguments, typename... Args> void tiny_log(Args... Rest) {
+  static_assert(Arguments == sizeof...(Args), "tiny_printf: the format does not match the arguments");
+  tiny_record_t Record;
+  Record.Data[0] = (uint8_t)Token;
+  Record.Data[1] = (uint8_t)(Token >> 8);
+  Record.Size = 2;
+  tiny_log_next(&Record, Rest...);
+  TinyPrintf_CFG_putrecord(Record.Data, Record.Size);
+}
+
+#if defined(TINY_PRINTF_TOKENIZED)
+#define tiny_printf(Format, ...) tiny_log<tiny_token(Format), tiny_format_args(Format)>(__VA_ARGS__)
+#else
+#define tiny_printf(Format, ...) tiny_print<tiny_format_args(Format)>(PSTR(Format), ##__VA_ARGS__)
+#endif
 #endif
 
 #endif // TINY_PRINTF_H
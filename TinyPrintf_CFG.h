@@ -7,6 +7,11 @@
 
 #include "USARTP.h"
 
-#define TinyPrintf_CFG_putch(c)  USARTP_Write(c)
+#define TinyPrintf_CFG_putch(c)  USARTP_WriteDebug(c)
+
+// C++ tiny_printf sends a token of the format and the binary arguments instead of text (see TinyLog.py)
+//#define TINY_PRINTF_TOKENIZED
+#define TinyPrintf_CFG_RECORD_SIZE 24 // Token and arguments, longer arguments are cut off
+#define TinyPrintf_CFG_putrecord(p, n)  USARTP_WriteDebugRecord(p, n)
 
 #endif // TINY_PRINTF_CFG_H_
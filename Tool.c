@@ -4,27 +4,24 @@
 
 #include "Tool.h"
 
-// Hex 0..9 and A..F (no lowercase)
-uint8_t ConvertHexToU8(uint8_t *pBuffer) {
-  uint8_t Value;
-
-  if (pBuffer[0] <= '9') {
-    pBuffer[0] -= '0';
-  } else {
-    pBuffer[0] -= '7';
+// Hex 0..9, A..F and a..f, returns 0xFF for a non hex character
+uint8_t ConvertHexNibble(uint8_t C) {
+  if ((uint8_t)(C - '0') <= 9) {
+    return C - '0';
   }
-
-  if (pBuffer[1] <= '9') {
-    pBuffer[1] -= '0';
-  } else {
-    pBuffer[1] -= '7';
+  C |= 0x20; // Lowercase
+  if ((uint8_t)(C - 'a') <= 5) {
+    return C - ('a' - 10);
   }
+  return 0xFF;
+}
 
-  Value = (uint8_t)(pBuffer[0]<<4) + pBuffer[1];
-  return Value;
+// The buffer is not changed, the characters must be checked with CheckHex
+uint8_t ConvertHexToU8(const uint8_t *pBuffer) {
+  return (uint8_t)(ConvertHexNibble(pBuffer[0])<<4) | ConvertHexNibble(pBuffer[1]);
 }
 
-uint16_t ConvertHexToU16(uint8_t *pBuffer) {
+uint16_t ConvertHexToU16(const uint8_t *pBuffer) {
   uint8_t ValueLow;
   uint8_t ValueHigh;
 
@@ -33,3 +30,16 @@ uint16_t ConvertHexToU16(uint8_t *pBuffer) {
 
   return (uint16_t)(ValueHigh*256) + (uint16_t)ValueLow;
 }
+
+// CRC-8, polynomial 0x07, initial value 0x00, Crc is the CRC of the previous bytes
+uint8_t CRC8_Update(uint8_t Crc, uint8_t Value) {
+  Crc ^= Value;
+  for (uint8_t i = 0; i < 8; i++) {
+    if (Crc & 0x80) {
+      Crc = (uint8_t)(Crc << 1) ^ 0x07;
+    } else {
+      Crc <<= 1;
+    }
+  }
+  return Crc;
+}
@@ -9,7 +9,7 @@
 extern "C" {
 #endif
 
-#include "Arduino.h"
+#include "HAL.h"
 #include <stdint.h>
 
 #define LED_Set      PORTB |= (1<<PORTB5) // Set D13
@@ -18,12 +18,15 @@ extern "C" {
 
 // delay 62.5ns on a 16MHz AtMega
 #define nop() __asm__ __volatile__ ("nop\n\t")
-#define CheckHex(C) (((C >= '0') && (C <= '9')) || ((C >= 'A') && (C <= 'F')))
+#define CheckHex(C) (ConvertHexNibble(C) <= 0x0F)
+#define ConvertNibbleToHex(N) ((N) < 10 ? '0' + (N) : 'A' - 10 + (N))
 #define CLIP(Value, Min, Max) if (Value < Min) { Value = Min; } else if (Value > Max) { Value = Max; }
 #define CLIPtoMin(Value, Min, Max) if (Value < Min) { Value = Min; } else if (Value > Max) { Value = Min; }
 
-uint8_t ConvertHexToU8(uint8_t *pBuffer);
-uint16_t ConvertHexToU16(uint8_t *pBuffer);
+uint8_t ConvertHexNibble(uint8_t C);
+uint8_t ConvertHexToU8(const uint8_t *pBuffer);
+uint16_t ConvertHexToU16(const uint8_t *pBuffer);
+uint8_t CRC8_Update(uint8_t Crc, uint8_t Value);
 
 #ifdef __cplusplus
 }
@@ -2,20 +2,36 @@
  * USARTP.c
  */
 
-#include "Arduino.h"
+#include "HAL.h"
 #include "USARTP.h"
 #include "USARTP_CFG.h"
 #if defined(DEBUG_USARTP_TEST)
 #include "TinyPrintf.h"
 #endif
 
+#if (USARTP_CFG_RX_BUFFER_SIZE & (USARTP_CFG_RX_BUFFER_SIZE - 1)) || (USARTP_CFG_RX_BUFFER_SIZE > 256)
+#error "USARTP_CFG_RX_BUFFER_SIZE must be a power of 2, 256 at most"
+#endif
+#if (USARTP_CFG_TX_BUFFER_SIZE & (USARTP_CFG_TX_BUFFER_SIZE - 1)) || (USARTP_CFG_TX_BUFFER_SIZE > 256)
+#error "USARTP_CFG_TX_BUFFER_SIZE must be a power of 2, 256 at most"
+#endif
+#if (USARTP_CFG_TX_DEBUG_BUFFER_SIZE & (USARTP_CFG_TX_DEBUG_BUFFER_SIZE - 1)) || (USARTP_CFG_TX_DEBUG_BUFFER_SIZE > 256)
+#error "USARTP_CFG_TX_DEBUG_BUFFER_SIZE must be a power of 2, 256 at most"
+#endif
+
 typedef struct {
   uint8_t RX_Head;
   uint8_t RX_Tail;
   uint8_t RX_Buffer[USARTP_CFG_RX_BUFFER_SIZE];
   uint8_t TX_Head;
   uint8_t TX_Tail;
-  uint8_t TX_Buffer[USARTP_CFG_TX_BUFFER_SIZE];
+  uint8_t TX_Buffer[USARTP_CFG_TX_BUFFER_SIZE]; // Protocol, always sent first
+  uint8_t TX_DebugHead;
+  uint8_t TX_DebugTail;
+  uint8_t TX_DebugBuffer[USARTP_CFG_TX_DEBUG_BUFFER_SIZE]; // Debug output, sent when there is no protocol data
+  uint8_t TX_DebugRecord; // Bytes left of the debug record being sent
+  uint16_t TX_Drops;
+  uint16_t TX_DebugDrops;
 } USARTP_t;
 
 static USARTP_t USARTP;
@@ -36,6 +52,10 @@ void USARTP_Initialize(uint32_t Baud) {
   USARTP.RX_Head = 0;
   USARTP.TX_Tail = 0;
   USARTP.TX_Head = 0;
+  USARTP.TX_DebugTail = 0;
+  USARTP.TX_DebugHead = 0;
+  USARTP.TX_DebugRecord = 0;
+  USARTP_ResetDrops();
 #if defined(DEBUG_USARTP_TEST)
   USARTP_Test();
 #endif
@@ -50,15 +70,20 @@ uint8_t USARTP_ReadEmpty(void) {
 }
 
 uint8_t USARTP_WriteEmpty(void) {
-  if (USARTP.TX_Tail == USARTP.TX_Head) {
+  if ((USARTP.TX_Tail == USARTP.TX_Head) && (USARTP.TX_DebugTail == USARTP.TX_DebugHead)) {
     return 1;
   } else {
     return 0;
   }
 }
 
+// Free bytes in the protocol buffer
+uint8_t USARTP_WriteFree(void) {
+  return (uint8_t)(USARTP.TX_Tail - USARTP.TX_Head - 1) & (USARTP_CFG_TX_BUFFER_SIZE - 1);
+}
+
 void USARTP_FlushTX_Buffer(void) {
-  while (USARTP.TX_Tail != USARTP.TX_Head) {
+  while (USARTP_WriteEmpty() == 0) {
     USARTP_Scheduler();  
   }
 }
@@ -103,49 +128,107 @@ void USARTP_Receive(void) {
 #if defined(DEBUG_USARTP_DIRECT_LOOPBACK) || defined(DEBUG_USARTP_LOOPBACK)
   uint8_t Value;
 #endif
-  if (UCSR0A & (1 << RXC0)) {
+  if (HAL_USART_RxReady()) {
     i = (USARTP.RX_Head + 1) & (USARTP_CFG_RX_BUFFER_SIZE - 1);
     if (i != USARTP.RX_Tail) {
 #if defined(DEBUG_USARTP_DIRECT_LOOPBACK)
-      Value = UDR0;
-      while (!(UCSR0A & (1 << UDRE0)));
-      UDR0 = Value;
+      Value = HAL_USART_RxData();
+      while (!HAL_USART_TxReady());
+      HAL_USART_TxData(Value);
       USARTP.RX_Buffer[USARTP.RX_Head] = Value;
 #elif defined(DEBUG_USARTP_LOOPBACK)
-      Value = UDR0;
+      Value = HAL_USART_RxData();
       USARTP_Write(Value);
       USARTP.RX_Buffer[USARTP.RX_Head] = Value;
 #else
-      USARTP.RX_Buffer[USARTP.RX_Head] = UDR0;
+      USARTP.RX_Buffer[USARTP.RX_Head] = HAL_USART_RxData();
 #endif
       USARTP.RX_Head = i;
     }
   }
 }
 
+// Protocol bytes first, debug bytes only when there is no protocol byte waiting
+// A debug record is always finished before a protocol byte is sent
 void USARTP_Transmit(void) {
-  uint8_t i;
-  if (UCSR0A & (1 << UDRE0)) {
-    if (USARTP.TX_Tail != USARTP.TX_Head) {
-      UDR0 = USARTP.TX_Buffer[USARTP.TX_Tail];
-      i = (USARTP.TX_Tail + 1) & (USARTP_CFG_RX_BUFFER_SIZE - 1);
-      USARTP.TX_Tail = i;
+  uint8_t Value;
+  if (HAL_USART_TxReady()) {
+    if ((USARTP.TX_Tail != USARTP.TX_Head) && (USARTP.TX_DebugRecord == 0)) {
+      HAL_USART_TxData(USARTP.TX_Buffer[USARTP.TX_Tail]);
+      USARTP.TX_Tail = (USARTP.TX_Tail + 1) & (USARTP_CFG_TX_BUFFER_SIZE - 1);
+    } else if (USARTP.TX_DebugTail != USARTP.TX_DebugHead) {
+      Value = USARTP.TX_DebugBuffer[USARTP.TX_DebugTail];
+      if (USARTP.TX_DebugRecord != 0) {
+        USARTP.TX_DebugRecord--;
+      } else if (Value == USARTP_DEBUG_RECORD_SOF) {
+        // Size and data follow, a record is always complete in the buffer
+        USARTP.TX_DebugRecord = USARTP.TX_DebugBuffer[(USARTP.TX_DebugTail + 1) & (USARTP_CFG_TX_DEBUG_BUFFER_SIZE - 1)] + 1;
+      }
+      HAL_USART_TxData(Value);
+      USARTP.TX_DebugTail = (USARTP.TX_DebugTail + 1) & (USARTP_CFG_TX_DEBUG_BUFFER_SIZE - 1);
     }
   }
 }
 
+// Protocol (command answers), returns 0 and counts a drop when the buffer is full
 uint8_t USARTP_Write(uint8_t Value) {
   uint8_t i;
-  i = (USARTP.TX_Head + 1) & (USARTP_CFG_RX_BUFFER_SIZE - 1);
+  i = (USARTP.TX_Head + 1) & (USARTP_CFG_TX_BUFFER_SIZE - 1);
   if (i != USARTP.TX_Tail) {
     USARTP.TX_Buffer[USARTP.TX_Head] = Value;
     USARTP.TX_Head = i;
     return 1;
   } else {
+    USARTP.TX_Drops++;
     return 0;
   }
 }
 
+// Debug output, returns 0 and counts a drop when the buffer is full
+uint8_t USARTP_WriteDebug(uint8_t Value) {
+  uint8_t i;
+  i = (USARTP.TX_DebugHead + 1) & (USARTP_CFG_TX_DEBUG_BUFFER_SIZE - 1);
+  if (i != USARTP.TX_DebugTail) {
+    USARTP.TX_DebugBuffer[USARTP.TX_DebugHead] = Value;
+    USARTP.TX_DebugHead = i;
+    return 1;
+  } else {
+    USARTP.TX_DebugDrops++;
+    return 0;
+  }
+}
+
+// Debug record <USARTP_DEBUG_RECORD_SOF><Size><Size data bytes>, written completely or dropped completely
+// Returns 0 and counts the dropped bytes when the buffer is full
+uint8_t USARTP_WriteDebugRecord(const uint8_t *pData, uint8_t Size) {
+  uint16_t Free;
+  uint8_t i;
+  Free = (uint8_t)(USARTP.TX_DebugTail - USARTP.TX_DebugHead - 1) & (USARTP_CFG_TX_DEBUG_BUFFER_SIZE - 1);
+  if (Free < (uint16_t)Size + 2) {
+    USARTP.TX_DebugDrops += (uint16_t)Size + 2;
+    return 0;
+  }
+  USARTP_WriteDebug(USARTP_DEBUG_RECORD_SOF);
+  USARTP_WriteDebug(Size);
+  for (i = 0; i < Size; i++) {
+    USARTP_WriteDebug(pData[i]);
+  }
+  return 1;
+}
+
+uint16_t USARTP_GetDrops(void) {
+  return USARTP.TX_Drops;
+}
+
+uint16_t USARTP_GetDebugDrops(void) {
+  return USARTP.TX_DebugDrops;
+}
+
+void USARTP_ResetDrops(void) {
+  USARTP.TX_Drops = 0;
+  USARTP.TX_DebugDrops = 0;
+}
+
 uint8_t USARTP_Read(uint8_t *Value) {
   if (USARTP.RX_Tail != USARTP.RX_Head) {
     *Value = USARTP.RX_Buffer[USARTP.RX_Tail];
@@ -168,15 +251,20 @@ void USARTP_Scheduler(void) {
       break;
     case 1:
       USARTP_Transmit();
+#if !defined(DEBUG_USARTP_LOOPBACK)
+      State = 0;
+#endif
       break;
 #if defined(DEBUG_USARTP_LOOPBACK)
     case 2:
       if (USARTP_Read(&C)) {
         USARTP_Write(C);
       }
+      State = 0;
       break;
 #endif
     default:
+      State = 0;
       break;
   }
 }
@@ -223,35 +311,35 @@ void USARTP_Test(void) {
   USARTP_FlushTX_Buffer();
   tiny_printf("String %s\n", Buffer);
   USARTP_FlushTX_Buffer(); 
-  tiny_printf("Decimal %d end\n", 123456);
+  tiny_printf("Decimal %ld end\n", 123456);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Decimal %d\n", Value1);
+  tiny_printf("Decimal %ld\n", Value1);
   USARTP_FlushTX_Buffer();  
-  tiny_printf("Integer %i\n", Value1);
+  tiny_printf("Integer %li\n", Value1);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Unsigned %u\n", Value1);
+  tiny_printf("Unsigned %lu\n", Value1);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Unsigned %u\n", Value2);
+  tiny_printf("Unsigned %lu\n", Value2);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 32b %x\n", Value1);
+  tiny_printf("Hexadecimal 32b %lx\n", Value1);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 32b %x\n", Value2);
+  tiny_printf("Hexadecimal 32b %lx\n", Value2);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 32b %8x\n", Value2);
+  tiny_printf("Hexadecimal 32b %8lx\n", Value2);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 32b %08x\n", Value2);
+  tiny_printf("Hexadecimal 32b %08lx\n", Value2);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 32b %08x\n", Value1);
+  tiny_printf("Hexadecimal 32b %08lx\n", Value1);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 16b %x\n", Value3);
+  tiny_printf("Hexadecimal 16b %lx\n", Value3);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 16b %x\n", Value4);
+  tiny_printf("Hexadecimal 16b %lx\n", Value4);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 16b %4x\n", Value4);
+  tiny_printf("Hexadecimal 16b %4lx\n", Value4);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Hexadecimal 16b %04x\n", Value4);
+  tiny_printf("Hexadecimal 16b %04lx\n", Value4);
   USARTP_FlushTX_Buffer();
-  tiny_printf("Pointer %p\n", Value1);
+  tiny_printf("Pointer %lx\n", Value1);
   USARTP_FlushTX_Buffer();
 
   tiny_printf("Text via Scheduler\n");
@@ -11,13 +11,22 @@ extern "C" {
 
 #include <stdint.h>
 
+// Start of a debug record, not used by debug text or the binary protocol (0xA0..0xAF)
+#define USARTP_DEBUG_RECORD_SOF 0xB0
+
 void USARTP_Initialize(uint32_t Baud);
 void USARTP_Scheduler(void);
 uint8_t USARTP_Write(uint8_t Value);
+uint8_t USARTP_WriteDebug(uint8_t Value);
+uint8_t USARTP_WriteDebugRecord(const uint8_t *pData, uint8_t Size);
 uint8_t USARTP_Read(uint8_t *Value);
 uint8_t USARTP_ReadEmpty(void);
 uint8_t USARTP_WriteEmpty(void);
+uint8_t USARTP_WriteFree(void);
 void USARTP_FlushTX_Buffer(void);
+uint16_t USARTP_GetDrops(void);
+uint16_t USARTP_GetDebugDrops(void);
+void USARTP_ResetDrops(void);
 
 #ifdef __cplusplus
 }
@@ -5,8 +5,10 @@
 #ifndef USARTP_CFG_H_
 #define USARTP_CFG_H_
 
-#define USARTP_CFG_RX_BUFFER_SIZE 256
-#define USARTP_CFG_TX_BUFFER_SIZE 256
+// Power of 2, 256 at most
+#define USARTP_CFG_RX_BUFFER_SIZE 128
+#define USARTP_CFG_TX_BUFFER_SIZE 128 // Protocol (command answers), always sent before debug output, 11 pipelined read replies
+#define USARTP_CFG_TX_DEBUG_BUFFER_SIZE 128 // Debug output (tiny_printf)
 
 //#define DEBUG_USARTP_TEST
 //#define DEBUG_USARTP_DIRECT_LOOPBACK